@@ -67,20 +67,23 @@
 *
 * Code Implementation Details(`calculatePiDigitsString`):
 * -----------------------------------------------------
-* - `n`: Number of decimal digits requested after "3.".
-* - `len`: Calculated size of the state array `a`. The formula `floor(10.0*n/3.0)+3`
+* - `n`: Number of decimal digits requested after "3.". It is a 64-bit count, and
+*   `len`, the loop indices and the buffers are sized in 64-bit/size_t arithmetic.
+* - `len`: Calculated size of the state array `a`. The formula `floor(10*n/3)+3`
 *   is an empirical value ensuring enough terms are included for the required
 *   precision. Since roughly log10(3) ~ 3.3 digits are produced per term, 10*n/3
-*   terms are needed. The `+3` provides a safety margin.
+*   terms are needed. The `+3` provides a safety margin. It is applied to n plus
+*   `SPIGOT_SPARE_DIGITS`, so that nines pending at the end can still be resolved.
 * - `a`: The vector representing the state of the calculation in the mixed-radix
 *   system. It's initialized with 2s, which is specific to the starting state of
 *   the formula variant used here.
-* - `calculated_digits`: Stores the computed decimal digits(after the decimal point)
-*   once they are confirmed(i.e., after handling the nines buffering).
+* - `calculated_digits`: Stores the confirmed digits(the leading 3 followed by the
+*   decimals, i.e., after handling the nines buffering) as ASCII characters, one byte
+*   per digit.
 * - `nines`, `predigit`: Variables for the output buffering mechanism described above.
 * - Outer loop(`j`): Iterates approximately `n` times, aiming to produce one
-*   confirmed digit(or resolve buffered nines) per iteration. The `n+3` limit
-*   provides buffer iterations.
+*   confirmed digit(or resolve buffered nines) per iteration. The limit of
+*   `n+3` plus the spare digits provides buffer iterations.
 * - Inner loop(`i`): Implements the core Spigot calculation step(multiply by 10,
 *   normalize, propagate carry) across the state array `a`, from right to left.
 * - Final Digit Extraction(`q`): Gets the candidate next digit after the inner loop.
@@ -88,9 +91,9 @@
 *   to append confirmed digits to `calculated_digits`.
 * - Termination: The loop breaks early if enough digits(`n+1`) have been stored
 *   in `calculated_digits`.
-* - Formatting: Uses `stringstream` to build the final output string "3." followed by
-*   the required number of digits from `calculated_digits`. Ensures no more than `n`
-*   digits are appended after the ".".
+* - Formatting: Truncates `calculated_digits` to at most `n` decimals and inserts the
+*   "." after the leading 3 in place, so the digit buffer itself becomes the returned
+*   string without a second copy or per-digit formatting.
 *
 */
 #include <iostream>
@@ -99,36 +102,119 @@
 #include <cmath>
 #include <iomanip>
 #include <string>
+#include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <cerrno>
 #include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <system_error>
+#include <cstring>
+#include <cstdio>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
-std::string calculatePiDigitsString(int n) {
+#include "PiTime.h"
+
+namespace pitime {
+
+/*
+* State Width:
+* ------------
+* Every entry of `a` is a remainder: a[i] < 2i+1 for i > 0, and a[0] < base(10 here,
+* 10^k for the limb engines). So `a` never holds more than max(2*(len-1), base-1), and
+* the narrowest unsigned type that holds that value is safe for the whole run; products
+* and carries are always formed in a wider accumulator. `spigotStateFits` is that
+* proof, checked once at startup before `a` is allocated. With uint16_t the state
+* covers len <= 32768(about 9800 digits) at half the memory traffic of uint32_t;
+* uint64_t is only needed once len exceeds 2^31.
+*/
+template <typename State>
+bool spigotStateFits(unsigned long long len, unsigned long long base) {
+    unsigned long long max_value = std::numeric_limits<State>::max();
+    return len > 0 && len - 1 <= max_value / 2 && base - 1 <= max_value;
+}
+
+// floor(10*n/3) + 3, formed without the 10*n that overflows for large n.
+size_t spigotStateLength(long long n) {
+    size_t digits = static_cast<size_t>(n);
+    return digits / 3 * 10 + digits % 3 * 10 / 3 + 3;
+}
+
+// Digits computed past the requested ones, so that a run of nines at the end of the
+// output is still resolved. Two spare digits leave n = 761..766 one decimal short in
+// front of the six nines from decimal 762 on; a run of 18 nines is only expected
+// around decimal 10^18, far beyond any spigot run.
+const int SPIGOT_SPARE_DIGITS = 18;
+
+template <typename State>
+std::string calculatePiDigitsString(long long n) {
     if (n <= 0) {
         return "3.";
     }
 
-    int len = static_cast<int>(std::floor(10.0 * n / 3.0)) + 3;
-    std::vector<int> a(len);
-    for (int i = 0; i < len; ++i) {
+    long long len = static_cast<long long>(spigotStateLength(n + SPIGOT_SPARE_DIGITS));
+    if (!spigotStateFits<State>(len, 10)) {
+        throw std::overflow_error("spigot state type too narrow for this digit count");
+    }
+    std::vector<State> a(len);
+    for (long long i = 0; i < len; ++i) {
         a[i] = 2;
     }
 
-    std::vector<int> calculated_digits;
-    calculated_digits.reserve(n + 5);
+    std::string calculated_digits;
+    calculated_digits.reserve(static_cast<size_t>(n) + 5);
 
-    int nines = 0;
+    long long nines = 0;
     int predigit = 0;
 
-    for (int j = 0; j < n + 3; ++j) {
+    for (long long j = 0; j < n + 3 + SPIGOT_SPARE_DIGITS; ++j) {
         long long carry = 0;
-        for (int i = len - 1; i > 0; --i) {
+        for (long long i = len - 1; i > 0; --i) {
             long long num = (long long)a[i] * 10 + carry;
-            a[i] = static_cast<int>(num % (2 * i + 1));
+            a[i] = static_cast<State>(num % (2 * i + 1));
             carry = num / (2 * i + 1) * i;
         }
         long long final_num = (long long)a[0] * 10 + carry;
         int q = static_cast<int>(final_num / 10);
-        a[0] = static_cast<int>(final_num % 10);
+        a[0] = static_cast<State>(final_num % 10);
 
         if (q >= 10) {
             q = 10;
@@ -136,16 +222,12 @@ std::string calculatePiDigitsString(int n) {
 
         if (j > 0) {
             if (q < 9) {
-                calculated_digits.push_back(predigit);
-                for (int k = 0; k < nines; ++k) {
-                    calculated_digits.push_back(9);
-                }
+                calculated_digits.push_back(static_cast<char>('0' + predigit));
+                calculated_digits.append(nines, '9');
             }
             else if (q == 10) {
-                calculated_digits.push_back(predigit + 1);
-                for (int k = 0; k < nines; ++k) {
-                    calculated_digits.push_back(0);
-                }
+                calculated_digits.push_back(static_cast<char>('0' + predigit + 1));
+                calculated_digits.append(nines, '0');
             }
         }
 
@@ -162,39 +244,5725 @@ std::string calculatePiDigitsString(int n) {
             if (j > 0) nines = 0;
         }
 
-        if (calculated_digits.size() >= n + 1) {
+        if (calculated_digits.size() >= static_cast<size_t>(n) + 1) {
+            break;
+        }
+    }
+
+    if (calculated_digits.empty()) {
+        return "3.";
+    }
+
+    size_t num_decimal_digits_available = calculated_digits.size() - 1;
+    size_t digits_to_print = std::min(static_cast<size_t>(n), num_decimal_digits_available);
+
+    calculated_digits.resize(1 + digits_to_print);
+    calculated_digits.insert(1, 1, '.');
+    return calculated_digits;
+}
+
+std::string calculatePiDigitsString(long long n) {
+    if (n > 0 && spigotStateFits<uint16_t>(spigotStateLength(n + SPIGOT_SPARE_DIGITS), 10)) {
+        return calculatePiDigitsString<uint16_t>(n);
+    }
+    return calculatePiDigitsString<uint32_t>(n);
+}
+
+
+/*
+* =======================================================================================
+* Multi-Digit Spigot(Base 10^k Limbs)
+* =======================================================================================
+*
+* The same mixed-radix state as `calculatePiDigitsString`, but every sweep multiplies by
+* `base` = 10^k instead of 10, so one pass over `a` yields a whole k-digit limb `q`.
+* - Position 0 uses `base` as its radix: the first sweep yields the integer part 3 and
+*   leaves the next k digits in a[0], so every later limb holds k decimal digits.
+* - The `predigit`/`nines` buffering(`SpigotLimbBuffer`) works on whole limbs: `nines`
+*   counts pending limbs equal to base-1, and a limb q >= base carries into `predigit`
+*   and turns the pending base-1 limbs into zeros. k = 1 is the single-digit scheme.
+* - Overflow: a[i] < 2i+1 and the carry into position i-1 stays below (2i+1)*base, so
+*   every `num` is below 4*len*base. The sweep kernels are instantiated with the
+*   narrowest accumulator that holds that bound; 10^4 stays in 32 bits for small N,
+*   10^9 needs 64 bits(or 128 bits past ~1.4*10^9 digits). The state array itself
+*   uses the narrowest of uint16_t/uint32_t/uint64_t that `spigotStateFits` accepts.
+* - `len` is sized for the digits the sweeps actually produce(n rounded up to whole
+*   limbs plus the limbs covering `SPIGOT_SPARE_DIGITS`, which resolve the buffered
+*   tail), while the number of sweeps drops by a factor of k.
+* A sweep is split into `spigotSweepRange`(positions hi-1 down to lo, carry in and out)
+* and `spigotFinishSweep`(position 0 and the output limb), so the same kernels serve
+* both the serial loop and the pipelined one below.
+*/
+
+template <typename Wide, typename State>
+Wide spigotSweepRange(State* a, size_t hi, size_t lo, uint32_t base, Wide carry) {
+    for (size_t i = hi - 1; i >= lo; --i) {
+        Wide num = static_cast<Wide>(a[i]) * base + carry;
+        Wide denominator = static_cast<Wide>(2 * i + 1);
+        a[i] = static_cast<State>(num % denominator);
+        carry = num / denominator * i;
+    }
+    return carry;
+}
+
+template <typename Wide, typename State>
+unsigned long long spigotFinishSweep(State* a, uint32_t base, Wide carry) {
+    Wide final_num = static_cast<Wide>(a[0]) * base + carry;
+    a[0] = static_cast<State>(final_num % base);
+    return static_cast<unsigned long long>(final_num / base);
+}
+
+/*
+* Reciprocal Division:
+* --------------------
+* `num % (2i+1)` and `num / (2i+1)` are two hardware divisions per element per sweep.
+* With `SpigotDivision::Reciprocal` each denominator d = 2i+1 gets a precomputed magic
+* multiplier(the libdivide "branchfree" unsigned 64-bit scheme): with L = floor(log2 d),
+*     magic = floor(2^(64+L) * 2 / d) + 1(rounded up when the doubled remainder >= d)
+*     q = mulhi(magic, num);  num / d = (((num - q) >> 1) + q) >> L
+* which is exact for every 64-bit `num`. The remainder is num - q*d. Only `magic` is
+* stored(8 bytes per element); L is tracked while walking i downwards. The table is
+* built once per `len` and shared by every sweep.
+*/
+
+inline uint64_t mulHigh64(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return __umulh(a, b);
+#else
+    uint64_t a_lo = a & 0xFFFFFFFFULL, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xFFFFFFFFULL, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFULL) + lo_hi;
+    return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+// floor((high * 2^64 + low) / d) for high < d.
+inline uint64_t divide128(uint64_t high, uint64_t low, uint64_t d, uint64_t& remainder) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 numerator = (static_cast<unsigned __int128>(high) << 64) | low;
+    remainder = static_cast<uint64_t>(numerator % d);
+    return static_cast<uint64_t>(numerator / d);
+#else
+    uint64_t quotient = 0;
+    for (int bit = 63; bit >= 0; --bit) {
+        bool overflow = (high >> 63) != 0;
+        high = (high << 1) | ((low >> bit) & 1);
+        quotient <<= 1;
+        if (overflow || high >= d) {
+            high -= d;
+            quotient |= 1;
+        }
+    }
+    remainder = high;
+    return quotient;
+#endif
+}
+
+inline int floorLog2(uint64_t value) {
+    int log = 0;
+    while (value >>= 1) {
+        ++log;
+    }
+    return log;
+}
+
+// The magic multiplier of a divisor d > 1; quotients use floorLog2(d) as the shift.
+inline uint64_t reciprocalMagic(uint64_t d) {
+    int log = floorLog2(d);
+    uint64_t remainder = 0;
+    uint64_t proposed = divide128(1ULL << log, 0, d, remainder);
+    proposed += proposed;
+    uint64_t twice_remainder = remainder + remainder;
+    if (twice_remainder >= d || twice_remainder < remainder) {
+        proposed += 1;
+    }
+    return proposed + 1;
+}
+
+// num / d for any 64-bit num, given magic = reciprocalMagic(d) and shift = floorLog2(d).
+inline uint64_t divideByMagic(uint64_t num, uint64_t magic, int shift) {
+    uint64_t high = mulHigh64(magic, num);
+    return (((num - high) >> 1) + high) >> shift;
+}
+
+class ReciprocalTable {
+public:
+    // Magic multipliers for the denominators 2i+1, 0 < i < len.
+    explicit ReciprocalTable(size_t len) : magic(len, 0) {
+        for (size_t i = 1; i < len; ++i) {
+            magic[i] = reciprocalMagic(2 * i + 1);
+        }
+    }
+
+    std::vector<uint64_t> magic;
+
+};
+
+template <typename State>
+uint64_t spigotSweepRangeReciprocal(State* a, size_t hi, size_t lo, uint32_t base, uint64_t carry,
+                                    const uint64_t* magic) {
+    int shift = floorLog2(2 * (hi - 1) + 1);
+    for (size_t i = hi - 1; i >= lo; --i) {
+        uint64_t denominator = 2 * i + 1;
+        if ((denominator >> shift) == 0) {
+            --shift;
+        }
+        uint64_t num = static_cast<uint64_t>(a[i]) * base + carry;
+        uint64_t quotient = divideByMagic(num, magic[i], shift);
+        a[i] = static_cast<State>(num - quotient * denominator);
+        carry = quotient * i;
+    }
+    return carry;
+}
+
+/*
+* Instrumentation(SpigotOptions::profile):
+* ----------------------------------------
+* `PerfCounterGroup` opens cycles, instructions, cache misses and branch misses as one
+* perf_event_open group on Linux(user space only, calling thread only), so a single
+* read() returns all four. Events the kernel or CPU refuses are left out, and on other
+* systems, or when every event fails(containers, perf_event_paranoid), only wall time
+* is measured. `SpigotProfile` accumulates readings per phase:
+* - Total: the whole sweep loop of a limb-spigot run.
+* - Resolve: the predigit/nines decision in `SpigotLimbBuffer::push`.
+* - Assemble: formatting confirmed limbs as ASCII and handing them to the sink.
+* The inner `i` sweep is reported as Total minus the other two, so the sweep loops
+* themselves carry no instrumentation. Each measured phase costs two counter reads,
+* which inflates the short Resolve/Assemble phases; compare runs with each other
+* rather than reading the small numbers as absolute. With `threads` > 1 the counters
+* only see the calling thread, i.e. the lowest block of the pipeline.
+*/
+PerfCounterGroup::PerfCounterGroup() : leader(-1), opened(0) {
+    for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        slot[e] = -1;
+    }
+#ifdef __linux__
+    const uint64_t configs[PERF_EVENT_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = configs[e];
+        attributes.disabled = (leader < 0) ? 1 : 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP;
+        long fd = syscall(__NR_perf_event_open, &attributes, 0, -1, leader, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (leader < 0) {
+            leader = static_cast<int>(fd);
+        }
+        else {
+            members.push_back(static_cast<int>(fd));
+        }
+        slot[e] = opened++;
+    }
+    if (leader >= 0) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+PerfCounterGroup::~PerfCounterGroup() {
+#ifdef __linux__
+    for (size_t m = 0; m < members.size(); ++m) {
+        close(members[m]);
+    }
+    if (leader >= 0) {
+        close(leader);
+    }
+#endif
+}
+
+PerfReading PerfCounterGroup::read() const {
+    PerfReading reading;
+    std::memset(&reading, 0, sizeof(reading));
+#ifdef __linux__
+    if (leader >= 0) {
+        uint64_t values[1 + PERF_EVENT_COUNT];
+        if (::read(leader, values, sizeof(values)) >= static_cast<ssize_t>(sizeof(uint64_t) * (1 + opened))) {
+            for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+                if (slot[e] >= 0) {
+                    reading.counts[e] = values[1 + slot[e]];
+                }
+            }
+        }
+    }
+#endif
+    reading.nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+    return reading;
+}
+
+// Adds the time and counts between construction and destruction to `phase`; a null
+// profile makes it a no-op.
+class SpigotProfileScope {
+public:
+    SpigotProfileScope(SpigotProfile* profile, SpigotPhase phase) : profile(profile), phase(phase), start() {
+        if (profile != nullptr) {
+            start = profile->read();
+        }
+    }
+
+    ~SpigotProfileScope() {
+        if (profile != nullptr) {
+            profile->add(phase, start, profile->read());
+        }
+    }
+
+private:
+    SpigotProfile* profile;
+    SpigotPhase phase;
+    PerfReading start;
+};
+
+void writeSpigotProfile(std::ostream& out, const SpigotProfile& profile) {
+    const char* names[PERF_EVENT_COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+    const PerfReading& total = profile.total(SpigotPhase::Total);
+    const PerfReading& resolve = profile.total(SpigotPhase::Resolve);
+    const PerfReading& assemble = profile.total(SpigotPhase::Assemble);
+    PerfReading sweep = total;
+    sweep.nanoseconds -= std::min(sweep.nanoseconds, resolve.nanoseconds + assemble.nanoseconds);
+    for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        sweep.counts[e] -= std::min(sweep.counts[e], resolve.counts[e] + assemble.counts[e]);
+    }
+
+    const char* phases[] = { "sweep", "resolve", "assemble", "total" };
+    const PerfReading* readings[] = { &sweep, &resolve, &assemble, &total };
+    out << std::left << std::setw(10) << "phase" << std::right << std::setw(14) << "time_ms";
+    for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+        out << std::setw(16) << names[e];
+    }
+    out << '\n';
+    for (int p = 0; p < 4; ++p) {
+        out << std::left << std::setw(10) << phases[p] << std::right << std::setw(14) << std::fixed
+            << std::setprecision(3) << readings[p]->nanoseconds / 1e6;
+        for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+            if (profile.counters().available(static_cast<PerfEvent>(e))) {
+                out << std::setw(16) << readings[p]->counts[e];
+            }
+            else {
+                out << std::setw(16) << "n/a";
+            }
+        }
+        out << '\n';
+    }
+}
+
+/*
+* Progress Reporting(SpigotOptions::progress):
+* --------------------------------------------
+* The run publishes its position in `SpigotProgress` with relaxed atomic stores once
+* per sweep(`SpigotLimbBuffer::push`), which compile to plain stores: no locks and no
+* system calls are added to the sweep loop. `ProgressReporter` samples it from its own
+* thread every `interval` and prints digits done, the digit rate over the last interval
+* and an ETA on standard error. Every sweep walks the whole state array, so the work
+* done after j sweeps is j * len element updates and the total is sweeps * len, which
+* grows as n^2; the ETA divides the remaining element updates by the update rate
+* measured so far, not the remaining digits by the digit rate. With a shrinking window
+* sweep j covers about len * (1 - j / sweeps) positions, and the work is summed that way.
+*/
+ProgressReporter::ProgressReporter(const SpigotProgress& progress, std::ostream& out, std::chrono::milliseconds interval)
+    : progress(progress), out(out), interval(interval), stopping(false) {
+    worker = std::thread([this]() { run(); });
+}
+
+void ProgressReporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+std::string ProgressReporter::formatDuration(double seconds) {
+    long long total = static_cast<long long>(seconds + 0.5);
+    std::string text;
+    if (total >= 3600) {
+        text += std::to_string(total / 3600) + "h";
+    }
+    if (total >= 60) {
+        text += std::to_string(total / 60 % 60) + "m";
+    }
+    return text + std::to_string(total % 60) + "s";
+}
+
+void ProgressReporter::run() {
+    auto start = std::chrono::steady_clock::now();
+    auto last_time = start;
+    unsigned long long last_digits = 0;
+    unsigned long long first_sweep = progress.sweeps_done.load(std::memory_order_relaxed);
+    bool reported = false;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        bool last = wake.wait_for(lock, interval, [this]() { return stopping; });
+        auto now = std::chrono::steady_clock::now();
+        unsigned long long sweeps = progress.sweeps_done.load(std::memory_order_relaxed);
+        unsigned long long total_sweeps = progress.sweeps_total.load(std::memory_order_relaxed);
+        unsigned long long digits = progress.digits_done.load(std::memory_order_relaxed);
+        unsigned long long total_digits = progress.digits_total.load(std::memory_order_relaxed);
+
+        if (total_sweeps > 0) {
+            double span = std::chrono::duration<double>(now - last_time).count();
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            double rate = (span > 0) ? (digits - last_digits) / span : 0.0;
+            double work_done = progress.workBefore(sweeps) - progress.workBefore(first_sweep);
+            double work_left = progress.workBefore(total_sweeps) - progress.workBefore(std::min(sweeps, total_sweeps));
+            out << "\rProgress: " << digits << "/" << total_digits << " digits ("
+                << std::fixed << std::setprecision(1) << (total_digits ? 100.0 * digits / total_digits : 100.0)
+                << "%), " << std::setprecision(0) << rate << " digits/s, ETA ";
+            if (work_done > 0 && elapsed > 0) {
+                out << formatDuration(work_left / (work_done / elapsed));
+            }
+            else {
+                out << "unknown";
+            }
+            out << "    " << std::flush;
+            reported = true;
+        }
+        last_time = now;
+        last_digits = digits;
+        if (last) {
             break;
         }
     }
+    if (reported) {
+        out << std::endl;
+    }
+}
+
+// predigit/nines buffering over whole limbs; confirmed digits go straight to `sink`.
+class SpigotLimbBuffer {
+public:
+    SpigotLimbBuffer(int limb_digits, uint32_t base, size_t decimals, const DigitSink& sink,
+                     SpigotProfile* profile = nullptr, SpigotProgress* progress = nullptr)
+        : limb_digits(limb_digits), base(base), wanted_digits(decimals + 1), sink(sink), profile(profile),
+          counters(progress), predigit(0), nines(0), limbs_seen(0), digits_emitted(0) {}
+
+    void push(unsigned long long q) {
+        if (done()) {
+            return;
+        }
+        if (counters != nullptr) {
+            counters->sweeps_done.store(limbs_seen + 1, std::memory_order_relaxed);
+        }
+        if (limbs_seen++ == 0) {
+            predigit = q;
+            return;
+        }
+
+        // A digit other than 9 confirms the predigit(plus one on a carry) and the run
+        // of nines(zeros on a carry) that followed it.
+        unsigned long long confirmed = 0, run_limb = 0, run = 0;
+        {
+            SpigotProfileScope scope(profile, SpigotPhase::Resolve);
+            if (q == base - 1) {
+                nines++;
+                return;
+            }
+            bool carry = q >= base;
+            confirmed = carry ? predigit + 1 : predigit;
+            run_limb = carry ? 0 : base - 1;
+            run = nines;
+            predigit = carry ? q - base : q;
+            nines = 0;
+        }
+
+        SpigotProfileScope scope(profile, SpigotPhase::Assemble);
+        appendLimb(confirmed, (digits_emitted == 0) ? 1 : limb_digits);
+        for (unsigned long long k = 0; k < run; ++k) {
+            appendLimb(run_limb, limb_digits);
+        }
+        flush();
+    }
+
+    bool done() const { return digits_emitted >= wanted_digits; }
+
+    // Sweeps pushed so far, i.e. the index of the next sweep.
+    unsigned long long sweepsSeen() const { return limbs_seen; }
+
+    // Everything `push` carries between calls(`pending` is always flushed by then).
+    struct Progress {
+        unsigned long long predigit;
+        unsigned long long nines;
+        unsigned long long limbs_seen;
+        unsigned long long digits_emitted;
+    };
+
+    Progress progress() const {
+        Progress saved = { predigit, nines, limbs_seen, digits_emitted };
+        return saved;
+    }
+
+    void restore(const Progress& saved) {
+        predigit = saved.predigit;
+        nines = saved.nines;
+        limbs_seen = saved.limbs_seen;
+        digits_emitted = static_cast<size_t>(saved.digits_emitted);
+    }
+
+private:
+    int limb_digits;
+    unsigned long long base;
+    size_t wanted_digits;
+    const DigitSink& sink;
+    SpigotProfile* profile;
+    SpigotProgress* counters;  // published for ProgressReporter, may be null
+    unsigned long long predigit;
+    unsigned long long nines;
+    unsigned long long limbs_seen;
+    size_t digits_emitted;
+    std::string pending;
+
+    // Queues one limb as `width` decimal digits; the first digit emitted is the "3".
+    void appendLimb(unsigned long long limb, int width) {
+        char buffer[10];
+        for (int k = width - 1; k >= 0; --k) {
+            buffer[k] = static_cast<char>('0' + limb % 10);
+            limb /= 10;
+        }
+        size_t count = std::min(static_cast<size_t>(width), wanted_digits - std::min(wanted_digits, digits_emitted));
+        if (count == 0) {
+            return;
+        }
+        if (digits_emitted == 0) {
+            pending.push_back(buffer[0]);
+            pending.push_back('.');
+            pending.append(buffer + 1, count - 1);
+        }
+        else {
+            pending.append(buffer, count);
+        }
+        digits_emitted += count;
+    }
+
+    void flush() {
+        if (counters != nullptr) {
+            // digits_emitted counts the leading "3"; decimals are reported.
+            counters->digits_done.store(digits_emitted > 0 ? digits_emitted - 1 : 0, std::memory_order_relaxed);
+        }
+        if (!pending.empty()) {
+            sink(pending.data(), pending.size());
+            pending.clear();
+        }
+    }
+};
+
+/*
+* Pipelined Spigot(SpigotOptions::threads > 1):
+* ---------------------------------------------
+* Within a sweep the carry only moves from high to low indices, and sweep j+1 over a
+* block only needs that block's own state plus the carry sweep j+1 produces above it.
+* So `a[1..len)` is cut into `threads` contiguous blocks, one per thread, and the
+* threads form a systolic pipeline: the thread owning block t waits for the carry of
+* sweep j from block t+1, sweeps its block, and hands its carry to block t-1 through a
+* lock-free single-producer/single-consumer ring(`SpscQueue`). The calling thread owns
+* the lowest block, finishes each sweep at position 0 and feeds `SpigotLimbBuffer`.
+* Up to `threads` sweeps are in flight at once. Every thread runs the full number of
+* sweeps(the serial loop may stop up to the spare limbs' sweeps earlier) so no
+* thread ever has to be cancelled; the extra limbs are ignored by the buffer.
+* Blocks smaller than `SPIGOT_MIN_BLOCK` positions are not worth a thread.
+*/
+const size_t SPIGOT_MIN_BLOCK = 4096;
+const size_t SPIGOT_QUEUE_CAPACITY = 64;
+
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : buffer(capacity + 1), head(0), tail(0) {}
+
+    void push(const T& value) {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % buffer.size();
+        while (next == head.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        buffer[current] = value;
+        tail.store(next, std::memory_order_release);
+    }
+
+    T pop() {
+        size_t current = head.load(std::memory_order_relaxed);
+        while (current == tail.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        T value = buffer[current];
+        head.store((current + 1) % buffer.size(), std::memory_order_release);
+        return value;
+    }
+
+private:
+    // Padding keeps the consumer's `head` and the producer's `tail` on separate cache
+    // lines without needing over-aligned `new`.
+    std::vector<T> buffer;
+    char padding_head[64];
+    std::atomic<size_t> head;
+    char padding_tail[64];
+    std::atomic<size_t> tail;
+};
+
+/*
+* Shrinking Window(SpigotOptions::shrink_window):
+* ------------------------------------------------
+* The state stands for x = sum_i a[i] * w_i with w_i = prod_{m=1..i} m/(2m+1) < 2^-i,
+* and after normalization a[i] <= 2i. Each later sweep multiplies x by `base` and takes
+* off the integer part. Position i therefore influences a digit r sweeps later, but
+* only by at most (2i+1) * w_i * base^r. Summed over the tail i >= L:
+*     sum_{i>=L} (2i+1) w_i  <=  4 * sqrt(L) * 2^-L,
+* so when sweep j still has r limbs of k digits to produce, positions
+*     L_j >= r * k * log2(10) + log2(4 sqrt(L)) + g
+* disturb the remaining output by less than 2^-g of its last unit. Freezing them is
+* then the same truncation `len` itself makes when it cuts the infinite series. It is
+* caught by the same predigit/nines and spare-limb margin, which the full-length
+* sweep relies on for its own cut-off. `SpigotWindow` uses
+*     L_j = spigotStateLength(r * k) + SPIGOT_WINDOW_GUARD,
+* where 10/3 > log2(10) per digit. The guard covers the log2(4 sqrt(L)) <= 22 term for
+* every len below 2^40 and leaves g >= 10 bits. The window starts at `len` and falls
+* linearly to a few positions, so a run does about half the element updates. At each
+* sweep the serial, tiled and pipelined kernels skip the positions at or above L_j;
+* the frozen entries stay in `a`(and in checkpoints) untouched. The SIMD wavefront
+* keeps the full length.
+*/
+const size_t SPIGOT_WINDOW_GUARD = 32;
+
+struct SpigotWindow {
+    size_t len;
+    int limb_digits;
+    long long total_digits;  // digits the sweeps produce, see `streamPiDigitsSpigot`
+    bool shrinking;
+
+    // Positions [0, at(sweep)) that sweep number `sweep`(0-based) has to process.
+    size_t at(unsigned long long sweep) const {
+        if (!shrinking || sweep <= 1) {
+            return len;
+        }
+        long long remaining = total_digits - static_cast<long long>(sweep - 1) * limb_digits;
+        if (remaining <= 0) {
+            return std::min(len, spigotStateLength(0) + SPIGOT_WINDOW_GUARD);
+        }
+        return std::min(len, spigotStateLength(remaining) + SPIGOT_WINDOW_GUARD);
+    }
+};
+
+/*
+* Cache-Blocked Sweeps(SpigotOptions::tile_elements):
+* ---------------------------------------------------
+* The same dependency argument applied within one thread gives temporal blocking:
+* `a[1..len)` is cut into tiles of `tile` positions, and each tile runs
+* `SPIGOT_TILE_SWEEPS` consecutive sweeps before the next tile below it starts. The
+* tile above has already produced the carries of all those sweeps(`carries[t]` for
+* sweep t), so every sweep over a tile has its input; the lowest tile's carries finish
+* the sweeps at position 0 in order. A tile is loaded from memory once per group of
+* sweeps instead of once per sweep. `SPIGOT_TILE_AUTO` sizes tiles to half of the L2
+* cache(`spigotCacheBytes`, 256 KiB when it cannot be detected), counting the reciprocal
+* table's 8 bytes per position when that kernel is used.
+* Tiling applies to the single-threaded sweep; in the pipeline every thread already
+* keeps its own block, and the SIMD wavefront runs its own 16-sweep groups.
+*/
+const size_t SPIGOT_TILE_SWEEPS = 64;
+const size_t SPIGOT_MIN_TILE = 1024;
+
+size_t spigotCacheBytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    long detected = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (detected > 0) {
+        return static_cast<size_t>(detected);
+    }
+#endif
+#ifdef __linux__
+    std::ifstream size_file("/sys/devices/system/cpu/cpu0/cache/index2/size");
+    unsigned long long kilobytes = 0;
+    if (size_file >> kilobytes && kilobytes > 0) {
+        return static_cast<size_t>(kilobytes) * 1024;
+    }
+#endif
+    return 256 * 1024;
+}
+
+// Tile length in positions for `requested`(SPIGOT_TILE_AUTO or an explicit length).
+size_t spigotTileElements(size_t requested, size_t bytes_per_element) {
+    if (requested == SPIGOT_TILE_AUTO) {
+        requested = spigotCacheBytes() / 2 / bytes_per_element;
+    }
+    return std::max(requested, SPIGOT_MIN_TILE);
+}
+
+template <typename Wide, typename State>
+void runSpigotSweepsTiled(std::vector<State>& a, uint32_t base, long long sweeps, size_t tile,
+                          const SpigotWindow& window, const std::function<Wide(size_t, size_t, Wide)>& sweep_range,
+                          SpigotLimbBuffer& buffer) {
+    std::vector<Wide> carries(SPIGOT_TILE_SWEEPS);
+    std::vector<size_t> active(SPIGOT_TILE_SWEEPS);
+    for (long long j = 0; j < sweeps && !buffer.done(); j += SPIGOT_TILE_SWEEPS) {
+        size_t group = static_cast<size_t>(std::min<long long>(SPIGOT_TILE_SWEEPS, sweeps - j));
+        std::fill(carries.begin(), carries.end(), Wide(0));
+        unsigned long long first = buffer.sweepsSeen();
+        for (size_t t = 0; t < group; ++t) {
+            active[t] = window.at(first + t);
+        }
+        for (size_t hi = active[0]; hi > 1;) {
+            size_t lo = (hi - 1 > tile) ? hi - tile : 1;
+            for (size_t t = 0; t < group && active[t] > lo; ++t) {
+                carries[t] = sweep_range(std::min(hi, active[t]), lo, carries[t]);
+            }
+            hi = lo;
+        }
+        for (size_t t = 0; t < group; ++t) {
+            buffer.push(spigotFinishSweep(a.data(), base, carries[t]));
+        }
+    }
+}
+
+template <typename Wide, typename State>
+void runSpigotSweeps(std::vector<State>& a, uint32_t base, long long sweeps, unsigned threads, size_t tile,
+                     const SpigotWindow& window, const std::function<Wide(size_t, size_t, Wide)>& sweep_range,
+                     SpigotLimbBuffer& buffer) {
+    size_t len = a.size();
+    size_t span = len - 1;
+    size_t blocks = std::max<size_t>(1, std::min<size_t>(threads, span / SPIGOT_MIN_BLOCK));
+
+    if (blocks == 1 && tile != 0 && tile < span) {
+        runSpigotSweepsTiled<Wide, State>(a, base, sweeps, tile, window, sweep_range, buffer);
+        return;
+    }
+    if (blocks == 1) {
+        for (long long j = 0; j < sweeps && !buffer.done(); ++j) {
+            Wide carry = sweep_range(window.at(buffer.sweepsSeen()), 1, 0);
+            buffer.push(spigotFinishSweep(a.data(), base, carry));
+        }
+        return;
+    }
+
+    std::vector<size_t> bounds(blocks + 1);
+    for (size_t t = 0; t <= blocks; ++t) {
+        bounds[t] = 1 + span * t / blocks;
+    }
+
+    // queues[t] carries sweep carries from block t+1 down into block t.
+    std::vector<std::unique_ptr<SpscQueue<Wide> > > queues;
+    for (size_t t = 0; t + 1 < blocks; ++t) {
+        queues.push_back(std::unique_ptr<SpscQueue<Wide> >(new SpscQueue<Wide>(SPIGOT_QUEUE_CAPACITY)));
+    }
+
+    // A block wholly above the window of a sweep passes the carry(then 0) straight down.
+    unsigned long long first = buffer.sweepsSeen();
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < blocks; ++t) {
+        workers.push_back(std::thread([&, t]() {
+            for (long long j = 0; j < sweeps; ++j) {
+                Wide carry = (t + 1 == blocks) ? Wide(0) : queues[t]->pop();
+                size_t hi = std::min(bounds[t + 1], window.at(first + j));
+                queues[t - 1]->push(hi > bounds[t] ? sweep_range(hi, bounds[t], carry) : carry);
+            }
+        }));
+    }
+
+    for (long long j = 0; j < sweeps; ++j) {
+        size_t hi = std::min(bounds[1], window.at(first + j));
+        Wide carry = sweep_range(hi, bounds[0], queues[0]->pop());
+        buffer.push(spigotFinishSweep(a.data(), base, carry));
+    }
+
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+}
+
+/*
+* SIMD Lane-Interleaved Sweeps(SpigotOptions::simd):
+* --------------------------------------------------
+* A single sweep cannot be vectorized because of the serial `carry`, but consecutive
+* sweeps can run side by side as a skewed wavefront inside one thread: lane l handles
+* sweep j+l one position above lane l-1,
+*     lane l at step t works on i = len-1-t+l,
+* so lane l always reads a[i] right after lane l-1 has finished with it, every lane
+* keeps its own carry, and the `SPIGOT_SIMD_LANES` positions touched in a step are
+* contiguous. Steps where every lane is inside [1, len) run through a vector kernel;
+* the ragged steps at the start and end of a group(including position 0 and the output
+* limb) use the scalar per-lane code, so the emitted limbs come out in sweep order.
+* - `spigotLaneRegionAvx2` does the multiply/reduce in double precision: num / d is
+*   computed with a correctly rounded vector division, floored, and corrected by one
+*   when the remainder num - q*d comes out negative. That is exact while every `num`
+*   stays below 2^52; larger runs fall back to the scalar kernels.
+* - The kernel is picked at runtime(`__builtin_cpu_supports`); `spigotLaneRegionPortable`
+*   is the same wavefront with integer arithmetic for other CPUs and compilers.
+* The SIMD path runs on the calling thread and ignores `division` and `threads`. The
+* vector kernel moves state entries through signed 32-bit lanes, so it is used for
+* uint16_t and uint32_t state with entries below 2^31.
+*/
+const size_t SPIGOT_SIMD_LANES = 16;
+
+template <typename State>
+void runSpigotSweepsSimd(std::vector<State>& a, uint32_t base, long long sweeps, SpigotLimbBuffer& buffer);
+
+// Only uint16_t/uint32_t state has a vector kernel; wider state reports false. With
+// zero sweeps the call only reports whether the vector kernel applies.
+template <typename State>
+bool trySpigotSweepsSimd(std::vector<State>&, uint32_t, long long, SpigotLimbBuffer&) {
+    return false;
+}
+
+template <>
+bool trySpigotSweepsSimd<uint16_t>(std::vector<uint16_t>& a, uint32_t base, long long sweeps, SpigotLimbBuffer& buffer) {
+    runSpigotSweepsSimd(a, base, sweeps, buffer);
+    return true;
+}
+
+template <>
+bool trySpigotSweepsSimd<uint32_t>(std::vector<uint32_t>& a, uint32_t base, long long sweeps, SpigotLimbBuffer& buffer) {
+    if (a.size() > (1ULL << 30)) {
+        return false;
+    }
+    runSpigotSweepsSimd(a, base, sweeps, buffer);
+    return true;
+}
+
+// Steps whose lane-0 position runs from `top` down to `bottom`(>= 1), all lanes active.
+template <typename State>
+void spigotLaneRegionPortable(State* a, size_t top, size_t bottom, uint32_t base, uint64_t* carry) {
+    for (size_t p = top; p >= bottom; --p) {
+        for (size_t l = 0; l < SPIGOT_SIMD_LANES; ++l) {
+            size_t i = p + l;
+            uint64_t num = static_cast<uint64_t>(a[i]) * base + carry[l];
+            uint64_t denominator = 2 * i + 1;
+            a[i] = static_cast<State>(num % denominator);
+            carry[l] = num / denominator * i;
+        }
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PITIME_HAVE_AVX2_KERNEL 1
+
+// Four state entries in and out of the low half of a vector register.
+__attribute__((target("avx2,fma"))) inline __m128i loadLaneState(const uint32_t* slot) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(slot));
+}
+
+__attribute__((target("avx2,fma"))) inline __m128i loadLaneState(const uint16_t* slot) {
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(slot)));
+}
+
+__attribute__((target("avx2,fma"))) inline void storeLaneState(uint32_t* slot, __m128i values) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(slot), values);
+}
+
+__attribute__((target("avx2,fma"))) inline void storeLaneState(uint16_t* slot, __m128i values) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(slot), _mm_packus_epi32(values, values));
+}
+
+template <typename State>
+__attribute__((target("avx2,fma")))
+void spigotLaneRegionAvx2(State* a, size_t top, size_t bottom, uint32_t base, uint64_t* carry) {
+    const size_t vectors = SPIGOT_SIMD_LANES / 4;
+    __m256d carries[vectors], indices[vectors];
+    for (size_t v = 0; v < vectors; ++v) {
+        carries[v] = _mm256_set_pd(static_cast<double>(carry[4 * v + 3]), static_cast<double>(carry[4 * v + 2]),
+                                   static_cast<double>(carry[4 * v + 1]), static_cast<double>(carry[4 * v]));
+        double first = static_cast<double>(top + 4 * v);
+        indices[v] = _mm256_set_pd(first + 3, first + 2, first + 1, first);
+    }
+    const __m256d base_v = _mm256_set1_pd(static_cast<double>(base));
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d zero = _mm256_setzero_pd();
 
-    std::stringstream pi_stream;
-    pi_stream << "3.";
+    for (size_t p = top; p >= bottom; --p) {
+        for (size_t v = 0; v < vectors; ++v) {
+            State* slot = a + p + 4 * v;
+            __m256d x = _mm256_cvtepi32_pd(loadLaneState(slot));
+            __m256d num = _mm256_fmadd_pd(x, base_v, carries[v]);
+            __m256d denominator = _mm256_fmadd_pd(indices[v], _mm256_set1_pd(2.0), one);
+            __m256d q = _mm256_floor_pd(_mm256_div_pd(num, denominator));
+            __m256d r = _mm256_fnmadd_pd(q, denominator, num);
+            __m256d low = _mm256_cmp_pd(r, zero, _CMP_LT_OQ);
+            q = _mm256_sub_pd(q, _mm256_and_pd(low, one));
+            r = _mm256_add_pd(r, _mm256_and_pd(low, denominator));
+            storeLaneState(slot, _mm256_cvttpd_epi32(r));
+            carries[v] = _mm256_mul_pd(q, indices[v]);
+            indices[v] = _mm256_sub_pd(indices[v], one);
+        }
+    }
 
-    int num_decimal_digits_available = (calculated_digits.size() > 0) ? calculated_digits.size() - 1 : 0;
-    int digits_to_print = std::min(n, num_decimal_digits_available);
+    for (size_t v = 0; v < vectors; ++v) {
+        double lanes[4];
+        _mm256_storeu_pd(lanes, carries[v]);
+        for (size_t k = 0; k < 4; ++k) {
+            carry[4 * v + k] = static_cast<uint64_t>(lanes[k]);
+        }
+    }
+}
+#endif
 
-    for (int i = 0; i < digits_to_print; ++i) {
-        pi_stream << calculated_digits[i + 1];
+template <typename State>
+void runSpigotSweepsSimd(std::vector<State>& a, uint32_t base, long long sweeps, SpigotLimbBuffer& buffer) {
+    void (*region)(State*, size_t, size_t, uint32_t, uint64_t*) = spigotLaneRegionPortable<State>;
+#ifdef PITIME_HAVE_AVX2_KERNEL
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        region = spigotLaneRegionAvx2<State>;
     }
+#endif
 
-    return pi_stream.str();
+    size_t len = a.size();
+    State* state = a.data();
+    for (long long j = 0; j < sweeps && !buffer.done(); j += SPIGOT_SIMD_LANES) {
+        size_t lanes = static_cast<size_t>(std::min<long long>(SPIGOT_SIMD_LANES, sweeps - j));
+        uint64_t carry[SPIGOT_SIMD_LANES] = {0};
+        size_t last_step = len - 1 + (lanes - 1);
+        for (size_t t = 0; t <= last_step; ++t) {
+            if (lanes == SPIGOT_SIMD_LANES && t + 1 >= lanes && t + 2 <= len) {
+                // Lane 0 runs from len-1-t down to 1; every lane is inside the array.
+                size_t top = len - 1 - t;
+                region(state, top, 1, base, carry);
+                t = len - 2;
+                continue;
+            }
+            for (size_t l = 0; l < lanes; ++l) {
+                if (t < l || t - l > len - 1) {
+                    continue;
+                }
+                size_t i = len - 1 - (t - l);
+                if (i > 0) {
+                    carry[l] = spigotSweepRange<uint64_t>(state, i + 1, i, base, carry[l]);
+                }
+                else {
+                    buffer.push(spigotFinishSweep(state, base, carry[l]));
+                }
+            }
+        }
+    }
 }
 
+/*
+* Checkpointing(SpigotOptions::checkpoint_path):
+* ----------------------------------------------
+* Every sweep applies the same operation to `a`, so between two sweeps the complete
+* state of a run is `a`, the number of sweeps done, the predigit/nines buffer
+* (`SpigotLimbBuffer::Progress`) and the digits emitted so far. The checkpoint file is
+* memory-mapped with the layout
+*     [file header][slot 0: slot header, a][slot 1: slot header, a][digits "3.xxxx"]
+* every part starting on a `SPIGOT_CHECKPOINT_ALIGN` boundary. Digits are only ever
+* appended, so they are copied into the map as they are emitted. A checkpoint copies `a`
+* into the older slot, flushes it together with the new digits, and only then writes
+* and flushes that slot's header(sequence number, counters and an FNV-1a checksum over
+* header and state). The other slot is never touched, so a crash in the middle of a
+* checkpoint still leaves the previous one to resume from. Resuming takes the valid slot
+* with the highest sequence number, replays its digits to the sink and runs the
+* remaining sweeps.
+* The run is cut into segments of about `SPIGOT_CHECKPOINT_SEGMENT` element updates;
+* after a segment a checkpoint is written once `checkpoint_seconds` have passed since
+* the previous one, and a final one is written when the run completes.
+*/
+const size_t SPIGOT_CHECKPOINT_ALIGN = 4096;
+const unsigned long long SPIGOT_CHECKPOINT_SEGMENT = 1ULL << 26;
+const char SPIGOT_CHECKPOINT_MAGIC[8] = { 'P', 'I', 'T', 'I', 'M', 'E', 'C', '1' };
 
-int main() {
-    const int N = 10000;
+// A file mapped read-write(or read-only) into memory; POSIX mmap or Win32 file mappings.
+class MappedFile {
+public:
+    MappedFile() : base(nullptr), length(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        fd = -1;
+#endif
+    }
 
-    auto start_time = std::chrono::high_resolution_clock::now();
+    ~MappedFile() { close(); }
 
-    std::string pi_digits = calculatePiDigitsString(N);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
 
-    auto end_time = std::chrono::high_resolution_clock::now();
+    // Creates(or truncates) `path` to `size` zero bytes and maps it read-write.
+    void create(const std::string& path, size_t size) {
+        close();
+        name = path;
+        length = size;
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+        if (file == INVALID_HANDLE_VALUE || !SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            fail("cannot create");
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            fail("cannot create");
+        }
+#endif
+        map(true);
+    }
 
-    std::cout << pi_digits << std::endl;
+    // Maps an existing file in full.
+    void open(const std::string& path, bool writable) {
+        close();
+        name = path;
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            fail("cannot open");
+        }
+        length = static_cast<size_t>(size.QuadPart);
+#else
+        fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            fail("cannot open");
+        }
+        length = static_cast<size_t>(info.st_size);
+#endif
+        map(writable);
+    }
 
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    // Writes [offset, offset + count) back to the file before returning.
+    void flush(size_t offset, size_t count) {
+        if (count == 0) {
+            return;
+        }
+#ifdef _WIN32
+        if (!FlushViewOfFile(base + offset, count) || !FlushFileBuffers(file)) {
+            fail("cannot flush");
+        }
+#else
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset / page * page;
+        if (msync(base + start, offset + count - start, MS_SYNC) != 0) {
+            fail("cannot flush");
+        }
+#endif
+    }
 
-    std::cout << "Calculation took " << duration.count() << " milliseconds." << std::endl;
+    void close() {
+#ifdef _WIN32
+        if (base != nullptr) {
+            UnmapViewOfFile(base);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        if (base != nullptr) {
+            munmap(base, length);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = -1;
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    char* data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    std::string name;
+    char* base;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    void map(bool writable) {
+        if (length == 0) {
+            close();
+            throw std::runtime_error("cannot map empty file '" + name + "'");
+        }
+#ifdef _WIN32
+        mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            base = static_cast<char*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+        }
+        if (base == nullptr) {
+            fail("cannot map");
+        }
+#else
+        void* address = mmap(nullptr, length, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            fail("cannot map");
+        }
+        base = static_cast<char*>(address);
+#endif
+    }
+
+    void fail(const char* what) {
+#ifdef _WIN32
+        std::string reason = "error " + std::to_string(GetLastError());
+#else
+        std::string reason = std::strerror(errno);
+#endif
+        close();
+        throw std::runtime_error(std::string(what) + " '" + name + "': " + reason);
+    }
+};
+
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t k = 0; k < size; ++k) {
+        hash ^= bytes[k];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct SpigotCheckpointHeader {
+    char magic[8];
+    uint32_t limb_digits;
+    uint32_t state_bytes;
+    uint64_t decimals;
+    uint64_t len;
+    uint64_t sweeps;
+};
+
+struct SpigotCheckpointSlot {
+    uint64_t sequence;      // 0: slot never written
+    uint64_t sweeps_done;
+    uint64_t predigit;
+    uint64_t nines;
+    uint64_t limbs_seen;
+    uint64_t digits_emitted;
+    uint64_t output_bytes;  // bytes of the digits region handed to the sink, "3." included
+    uint64_t checksum;
+};
+
+class SpigotCheckpoint {
+public:
+    // Creates a fresh checkpoint file, or with `resume` maps an existing one and checks
+    // that it belongs to the same run(digits, limb size, state width and length).
+    SpigotCheckpoint(const std::string& path, bool resume, int limb_digits, size_t state_bytes, long long decimals,
+                     size_t len, long long sweeps)
+        : state_size(len * state_bytes), active(-1), sequence(0), digits_written(0), digits_flushed(0) {
+        slot_stride = roundUp(sizeof(SpigotCheckpointSlot) + state_size);
+        digits_offset = SPIGOT_CHECKPOINT_ALIGN + 2 * slot_stride;
+        digits_capacity = static_cast<size_t>(decimals) + 2;
+
+        SpigotCheckpointHeader expected;
+        std::memset(&expected, 0, sizeof(expected));
+        std::memcpy(expected.magic, SPIGOT_CHECKPOINT_MAGIC, sizeof(expected.magic));
+        expected.limb_digits = static_cast<uint32_t>(limb_digits);
+        expected.state_bytes = static_cast<uint32_t>(state_bytes);
+        expected.decimals = static_cast<uint64_t>(decimals);
+        expected.len = len;
+        expected.sweeps = static_cast<uint64_t>(sweeps);
+
+        if (!resume) {
+            file.create(path, digits_offset + digits_capacity);
+            std::memcpy(file.data(), &expected, sizeof(expected));
+            file.flush(0, sizeof(expected));
+            return;
+        }
+
+        file.open(path, true);
+        if (file.size() != digits_offset + digits_capacity ||
+            std::memcmp(file.data(), &expected, sizeof(expected)) != 0) {
+            throw std::runtime_error("checkpoint '" + path + "' was written for a different run");
+        }
+        for (int index = 0; index < 2; ++index) {
+            SpigotCheckpointSlot saved = slotHeader(index);
+            if (saved.sequence > sequence && saved.output_bytes <= digits_capacity &&
+                saved.checksum == checksum(saved, slotState(index))) {
+                active = index;
+                sequence = saved.sequence;
+            }
+        }
+        if (active >= 0) {
+            digits_written = static_cast<size_t>(slotHeader(active).output_bytes);
+            digits_flushed = digits_written;
+        }
+    }
+
+    bool resumed() const { return active >= 0; }
+
+    long long sweepsDone() const { return static_cast<long long>(slotHeader(active).sweeps_done); }
+
+    SpigotLimbBuffer::Progress progress() const {
+        SpigotCheckpointSlot saved = slotHeader(active);
+        SpigotLimbBuffer::Progress restored = { saved.predigit, saved.nines, saved.limbs_seen, saved.digits_emitted };
+        return restored;
+    }
+
+    // The digits confirmed when the resumed checkpoint was written.
+    const char* digits() const { return file.data() + digits_offset; }
+    size_t digitCount() const { return digits_written; }
+
+    void loadState(void* a) const { std::memcpy(a, slotState(active), state_size); }
+
+    void recordDigits(const char* digits, size_t count) {
+        count = std::min(count, digits_capacity - digits_written);
+        std::memcpy(file.data() + digits_offset + digits_written, digits, count);
+        digits_written += count;
+    }
+
+    void save(const void* a, long long sweeps_done, const SpigotLimbBuffer::Progress& progress) {
+        int target = (active == 0) ? 1 : 0;
+        char* state = slotState(target);
+        std::memcpy(state, a, state_size);
+        file.flush(digits_offset + digits_flushed, digits_written - digits_flushed);
+        file.flush(static_cast<size_t>(state - file.data()), state_size);
+        digits_flushed = digits_written;
+
+        SpigotCheckpointSlot saved;
+        saved.sequence = ++sequence;
+        saved.sweeps_done = static_cast<uint64_t>(sweeps_done);
+        saved.predigit = progress.predigit;
+        saved.nines = progress.nines;
+        saved.limbs_seen = progress.limbs_seen;
+        saved.digits_emitted = progress.digits_emitted;
+        saved.output_bytes = digits_written;
+        saved.checksum = checksum(saved, state);
+        size_t header_offset = SPIGOT_CHECKPOINT_ALIGN + target * slot_stride;
+        std::memcpy(file.data() + header_offset, &saved, sizeof(saved));
+        file.flush(header_offset, sizeof(saved));
+        active = target;
+    }
+
+private:
+    MappedFile file;
+    size_t state_size;
+    size_t slot_stride;
+    size_t digits_offset;
+    size_t digits_capacity;
+    int active;  // slot holding the newest checkpoint, -1 before the first one
+    uint64_t sequence;
+    size_t digits_written;
+    size_t digits_flushed;
+
+    static size_t roundUp(size_t bytes) {
+        return (bytes + SPIGOT_CHECKPOINT_ALIGN - 1) / SPIGOT_CHECKPOINT_ALIGN * SPIGOT_CHECKPOINT_ALIGN;
+    }
+
+    SpigotCheckpointSlot slotHeader(int index) const {
+        SpigotCheckpointSlot saved;
+        std::memcpy(&saved, file.data() + SPIGOT_CHECKPOINT_ALIGN + index * slot_stride, sizeof(saved));
+        return saved;
+    }
+
+    char* slotState(int index) const {
+        return file.data() + SPIGOT_CHECKPOINT_ALIGN + index * slot_stride + sizeof(SpigotCheckpointSlot);
+    }
+
+    uint64_t checksum(SpigotCheckpointSlot saved, const char* state) const {
+        saved.checksum = 0;
+        return fnv1a64(state, state_size, fnv1a64(&saved, sizeof(saved)));
+    }
+};
+
+/*
+* Out-of-Core State(SpigotOptions::memory_budget):
+* ------------------------------------------------
+* Around 10^9 digits `a` outgrows memory(3.3 * 10^9 positions). When it is larger than
+* `memory_budget`, a[1..len) lives in the spill file and only a[0] stays in memory. The
+* run is the cache-blocked sweep of above with disk segments for tiles:
+* - The positions are cut into segments of a third of the budget. A group of
+*   `SPIGOT_SPILL_SWEEPS` sweeps walks the segments from the top down, in the order
+*   the carries flow; each segment runs every sweep of the group before the next one
+*   below it starts, so the file is read and written once per group, not once per sweep.
+* - Three segment buffers rotate: while a segment is swept, `SpigotSpillFile`'s I/O
+*   thread writes back the one above it and reads ahead the one below. Its transfers
+*   run strictly in the order they are queued, so a buffer is never read into before
+*   its previous segment has been written out. Every transfer is a large sequential
+*   pread/pwrite.
+* - With a shrinking window only the positions below the group's window are read and
+*   written, so the file traffic shrinks with the work.
+* At 64 sweeps per group the file traffic is 2 * sizeof(State) / 64 bytes per element
+* update, well below what a sweep spends on its divisions, so a run proceeds at close
+* to its in-memory speed as long as the disk keeps up(a few hundred MB/s).
+* An out-of-core run uses the serial hardware-division sweep whatever the kernel options
+* say; checkpoints need `a` in memory and are refused. The spill file is removed when
+* the run ends.
+*/
+const unsigned SPIGOT_SPILL_SWEEPS = 64;
+const size_t SPIGOT_SPILL_MIN_SEGMENT = 1 << 16;
+
+// Reads and writes of the spill file on a thread of its own, in the order queued.
+class SpigotSpillFile {
+public:
+    explicit SpigotSpillFile(const std::string& path)
+        : path(path.empty() ? SPIGOT_SPILL_DEFAULT : path), queued(0), completed(0), stopping(false) {
+#ifdef _WIN32
+        file = std::fopen(this->path.c_str(), "w+b");
+        if (!file) {
+            throw std::runtime_error("cannot create spill file '" + this->path + "'");
+        }
+#else
+        fd = ::open(this->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("cannot create spill file '" + this->path + "': " + std::strerror(errno));
+        }
+#endif
+        worker = std::thread(&SpigotSpillFile::run, this);
+    }
+
+    ~SpigotSpillFile() {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = true;
+        }
+        queue_ready.notify_all();
+        worker.join();
+#ifdef _WIN32
+        std::fclose(file);
+#else
+        ::close(fd);
+#endif
+        std::remove(path.c_str());
+    }
+
+    SpigotSpillFile(const SpigotSpillFile&) = delete;
+    SpigotSpillFile& operator=(const SpigotSpillFile&) = delete;
+
+    // Queue a transfer between `data` and the file at `offset`; returns its ticket.
+    unsigned long long read(void* data, unsigned long long offset, size_t bytes) {
+        return queue(Transfer{ false, static_cast<char*>(data), offset, bytes });
+    }
+
+    unsigned long long write(const void* data, unsigned long long offset, size_t bytes) {
+        return queue(Transfer{ true, static_cast<char*>(const_cast<void*>(data)), offset, bytes });
+    }
+
+    // Waits until the transfer `ticket`(and every one before it) is done; rethrows the
+    // first I/O error.
+    void wait(unsigned long long ticket) {
+        std::unique_lock<std::mutex> guard(mutex);
+        transfer_done.wait(guard, [&]() { return completed >= ticket || failure; });
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+private:
+    struct Transfer {
+        bool write;
+        char* data;
+        unsigned long long offset;
+        size_t bytes;
+    };
+
+    std::string path;
+#ifdef _WIN32
+    std::FILE* file;
+#else
+    int fd;
+#endif
+    std::mutex mutex;
+    std::condition_variable queue_ready;
+    std::condition_variable transfer_done;
+    std::deque<Transfer> transfers;
+    unsigned long long queued;
+    unsigned long long completed;
+    std::exception_ptr failure;
+    bool stopping;
+    std::thread worker;
+
+    unsigned long long queue(const Transfer& transfer) {
+        std::lock_guard<std::mutex> guard(mutex);
+        transfers.push_back(transfer);
+        queue_ready.notify_one();
+        return ++queued;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(mutex);
+        while (true) {
+            queue_ready.wait(guard, [this]() { return stopping || !transfers.empty(); });
+            if (transfers.empty()) {
+                return;
+            }
+            Transfer next = transfers.front();
+            transfers.pop_front();
+            guard.unlock();
+            try {
+                perform(next);
+            }
+            catch (...) {
+                guard.lock();
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+                transfer_done.notify_all();
+                continue;
+            }
+            guard.lock();
+            ++completed;
+            transfer_done.notify_all();
+        }
+    }
+
+    void perform(const Transfer& transfer) {
+#ifdef _WIN32
+        bool ok = _fseeki64(file, static_cast<long long>(transfer.offset), SEEK_SET) == 0 &&
+                  (transfer.write ? std::fwrite(transfer.data, 1, transfer.bytes, file)
+                                  : std::fread(transfer.data, 1, transfer.bytes, file)) == transfer.bytes;
+        if (!ok) {
+            throw std::runtime_error("cannot " + std::string(transfer.write ? "write" : "read") + " spill file '" +
+                                     path + "'");
+        }
+#else
+        size_t done = 0;
+        while (done < transfer.bytes) {
+            off_t at = static_cast<off_t>(transfer.offset + done);
+            ssize_t moved = transfer.write ? ::pwrite(fd, transfer.data + done, transfer.bytes - done, at)
+                                           : ::pread(fd, transfer.data + done, transfer.bytes - done, at);
+            if (moved < 0 && errno == EINTR) {
+                continue;
+            }
+            if (moved <= 0) {
+                std::string reason = (moved == 0) ? "unexpected end of file" : std::strerror(errno);
+                throw std::runtime_error("cannot " + std::string(transfer.write ? "write" : "read") +
+                                         " spill file '" + path + "': " + reason);
+            }
+            done += static_cast<size_t>(moved);
+        }
+#endif
+    }
+};
+
+// spigotSweepRange on a segment of `a` whose first element is position `first`.
+template <typename Wide, typename State>
+Wide spigotSweepSegment(State* segment, size_t first, size_t hi, size_t lo, uint32_t base, Wide carry) {
+    for (size_t i = hi - 1; i >= lo; --i) {
+        Wide num = static_cast<Wide>(segment[i - first]) * base + carry;
+        Wide denominator = static_cast<Wide>(2 * i + 1);
+        segment[i - first] = static_cast<State>(num % denominator);
+        carry = num / denominator * i;
+    }
+    return carry;
+}
+
+template <typename Wide, typename State>
+void runSpigotSweepsSpilled(size_t len, uint32_t base, long long sweeps, const SpigotWindow& window,
+                            const SpigotOptions& options, SpigotLimbBuffer& buffer) {
+    size_t segment = std::max<size_t>(SPIGOT_SPILL_MIN_SEGMENT,
+                                      static_cast<size_t>(options.memory_budget / (3 * sizeof(State))));
+    segment = std::min(segment, len - 1);
+    std::vector<State> buffers[3] = { std::vector<State>(segment, 2), std::vector<State>(segment),
+                                      std::vector<State>(segment) };
+    SpigotSpillFile file(options.spill_path);
+    unsigned long long last_write = 0;
+    for (size_t lo = 1; lo < len; lo += segment) {
+        size_t count = std::min(segment, len - lo);
+        last_write = file.write(buffers[0].data(), (lo - 1) * sizeof(State), count * sizeof(State));
+    }
+    State head = 2;
+
+    std::vector<Wide> carries(SPIGOT_SPILL_SWEEPS);
+    std::vector<size_t> active(SPIGOT_SPILL_SWEEPS);
+    for (long long j = 0; j < sweeps && !buffer.done(); j += SPIGOT_SPILL_SWEEPS) {
+        size_t group = static_cast<size_t>(std::min<long long>(SPIGOT_SPILL_SWEEPS, sweeps - j));
+        std::fill(carries.begin(), carries.end(), Wide(0));
+        unsigned long long first = buffer.sweepsSeen();
+        for (size_t t = 0; t < group; ++t) {
+            active[t] = window.at(first + t);
+        }
+        // Segment k covers positions [1 + k * segment, 1 + (k + 1) * segment); only the
+        // part below active[0] is touched by this group.
+        size_t top = (active[0] > 1) ? (active[0] - 2) / segment + 1 : 0;
+        auto extent = [&](size_t k) { return std::min(segment, active[0] - (1 + k * segment)); };
+        unsigned long long next_read = 0;
+        if (top > 0) {
+            next_read = file.read(buffers[0].data(), (top - 1) * segment * sizeof(State),
+                                  extent(top - 1) * sizeof(State));
+        }
+        for (size_t k = top; k-- > 0;) {
+            State* data = buffers[(top - 1 - k) % 3].data();
+            size_t lo = 1 + k * segment;
+            size_t count = extent(k);
+            file.wait(next_read);
+            if (k > 0) {
+                next_read = file.read(buffers[(top - k) % 3].data(), (k - 1) * segment * sizeof(State),
+                                      extent(k - 1) * sizeof(State));
+            }
+            for (size_t t = 0; t < group && active[t] > lo; ++t) {
+                carries[t] = spigotSweepSegment<Wide, State>(data, lo, std::min(lo + count, active[t]), lo, base,
+                                                             carries[t]);
+            }
+            last_write = file.write(data, (lo - 1) * sizeof(State), count * sizeof(State));
+        }
+        for (size_t t = 0; t < group; ++t) {
+            buffer.push(spigotFinishSweep(&head, base, carries[t]));
+        }
+    }
+    file.wait(last_write);
+}
+
+template <typename State>
+void runSpigotOutOfCore(size_t len, uint32_t base, long long sweeps, int limb_digits, long long n,
+                        const SpigotOptions& options, const DigitSink& sink) {
+    if (!options.checkpoint_path.empty()) {
+        throw std::invalid_argument("checkpoints need the spigot state in memory; raise the memory budget");
+    }
+    SpigotLimbBuffer buffer(limb_digits, base, static_cast<size_t>(n), sink, options.profile, options.progress);
+    SpigotWindow window = { len, limb_digits, static_cast<long long>(sweeps - 1) * limb_digits,
+                            options.shrink_window };
+    if (options.progress != nullptr) {
+        options.progress->begin(static_cast<unsigned long long>(sweeps), len, static_cast<unsigned long long>(n),
+                                window.shrinking);
+    }
+    SpigotProfileScope scope(options.profile, SpigotPhase::Total);
+    double num_bound = 4.0 * static_cast<double>(len) * base;
+    if (num_bound < 4294967296.0) {
+        runSpigotSweepsSpilled<uint32_t, State>(len, base, sweeps, window, options, buffer);
+    }
+    else if (num_bound < 18446744073709551616.0) {
+        runSpigotSweepsSpilled<uint64_t, State>(len, base, sweeps, window, options, buffer);
+    }
+    else {
+#ifdef __SIZEOF_INT128__
+        runSpigotSweepsSpilled<unsigned __int128, State>(len, base, sweeps, window, options, buffer);
+#else
+        throw std::length_error("digit count too large for 64-bit spigot accumulators");
+#endif
+    }
+}
+
+template <typename State>
+void runSpigotWithState(size_t len, uint32_t base, long long sweeps, int limb_digits, long long n,
+                        const SpigotOptions& options, const DigitSink& sink) {
+    if (options.memory_budget != 0 && len > 1 && static_cast<double>(len) * sizeof(State) > options.memory_budget) {
+        runSpigotOutOfCore<State>(len, base, sweeps, limb_digits, n, options, sink);
+        return;
+    }
+    std::vector<State> a(len, 2);
+    std::unique_ptr<SpigotCheckpoint> checkpoint;
+    DigitSink recording_sink;
+    if (!options.checkpoint_path.empty()) {
+        checkpoint.reset(new SpigotCheckpoint(options.checkpoint_path, options.resume, limb_digits, sizeof(State), n,
+                                              len, sweeps));
+        SpigotCheckpoint* file = checkpoint.get();
+        recording_sink = [file, &sink](const char* digits, size_t count) {
+            file->recordDigits(digits, count);
+            sink(digits, count);
+        };
+    }
+    SpigotLimbBuffer buffer(limb_digits, base, static_cast<size_t>(n), checkpoint ? recording_sink : sink,
+                            options.profile, options.progress);
+    bool simd = options.simd && 4.0 * static_cast<double>(len) * base < 4503599627370496.0 &&
+                trySpigotSweepsSimd(a, base, 0, buffer);
+    SpigotWindow window = { len, limb_digits, static_cast<long long>(sweeps - 1) * limb_digits,
+                            options.shrink_window && !simd };
+    if (options.progress != nullptr) {
+        options.progress->begin(static_cast<unsigned long long>(sweeps), len, static_cast<unsigned long long>(n),
+                                window.shrinking);
+    }
+
+    long long sweeps_done = 0;
+    if (checkpoint && checkpoint->resumed()) {
+        checkpoint->loadState(a.data());
+        buffer.restore(checkpoint->progress());
+        sweeps_done = checkpoint->sweepsDone();
+        if (checkpoint->digitCount() > 0) {
+            sink(checkpoint->digits(), checkpoint->digitCount());
+        }
+    }
+
+    // run_sweeps(count) advances `a` and `buffer` by `count` sweeps with the chosen kernel.
+    std::function<void(long long)> run_sweeps;
+    unsigned threads = std::max(1u, options.threads);
+    State* state = a.data();
+    double num_bound = 4.0 * static_cast<double>(len) * base;
+    std::unique_ptr<ReciprocalTable> reciprocals;
+    size_t tile = 0;
+    if (options.tile_elements != 0) {
+        size_t table_bytes = (options.division == SpigotDivision::Reciprocal) ? sizeof(uint64_t) : 0;
+        tile = spigotTileElements(options.tile_elements, sizeof(State) + table_bytes);
+    }
+    if (simd) {
+        run_sweeps = [&](long long count) {
+            trySpigotSweepsSimd(a, base, count, buffer);
+        };
+    }
+    else if (options.division == SpigotDivision::Reciprocal) {
+        if (num_bound >= 18446744073709551616.0) {
+            throw std::length_error("digit count too large for 64-bit reciprocal division");
+        }
+        reciprocals.reset(new ReciprocalTable(len));
+        const uint64_t* magic = reciprocals->magic.data();
+        run_sweeps = [&, state, magic](long long count) {
+            runSpigotSweeps<uint64_t, State>(a, base, count, threads, tile, window,
+                                             [=](size_t hi, size_t lo, uint64_t carry) {
+                return spigotSweepRangeReciprocal(state, hi, lo, base, carry, magic);
+            }, buffer);
+        };
+    }
+    else if (num_bound < 4294967296.0) {
+        run_sweeps = [&, state](long long count) {
+            runSpigotSweeps<uint32_t, State>(a, base, count, threads, tile, window,
+                                             [=](size_t hi, size_t lo, uint32_t carry) {
+                return spigotSweepRange<uint32_t>(state, hi, lo, base, carry);
+            }, buffer);
+        };
+    }
+    else if (num_bound < 18446744073709551616.0) {
+        run_sweeps = [&, state](long long count) {
+            runSpigotSweeps<uint64_t, State>(a, base, count, threads, tile, window,
+                                             [=](size_t hi, size_t lo, uint64_t carry) {
+                return spigotSweepRange<uint64_t>(state, hi, lo, base, carry);
+            }, buffer);
+        };
+    }
+    else {
+#ifdef __SIZEOF_INT128__
+        typedef unsigned __int128 Wide128;
+        run_sweeps = [&, state](long long count) {
+            runSpigotSweeps<Wide128, State>(a, base, count, threads, tile, window,
+                                             [=](size_t hi, size_t lo, Wide128 carry) {
+                return spigotSweepRange<Wide128>(state, hi, lo, base, carry);
+            }, buffer);
+        };
+#else
+        throw std::length_error("digit count too large for 64-bit spigot accumulators");
+#endif
+    }
+
+    SpigotProfileScope scope(options.profile, SpigotPhase::Total);
+    if (!checkpoint) {
+        run_sweeps(sweeps);
+        return;
+    }
+
+    // Segments are a multiple of the SIMD group size so every segment ends on a group.
+    long long segment = static_cast<long long>(SPIGOT_CHECKPOINT_SEGMENT / len);
+    segment = std::max<long long>(1, (segment + SPIGOT_SIMD_LANES - 1) / SPIGOT_SIMD_LANES) * SPIGOT_SIMD_LANES;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    while (sweeps_done < sweeps && !buffer.done()) {
+        long long count = std::min(segment, sweeps - sweeps_done);
+        run_sweeps(count);
+        sweeps_done += count;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_checkpoint >= std::chrono::seconds(options.checkpoint_seconds)) {
+            checkpoint->save(a.data(), sweeps_done, buffer.progress());
+            last_checkpoint = now;
+        }
+    }
+    checkpoint->save(a.data(), sweeps_done, buffer.progress());
+}
+
+// Limb base, state length and sweep count of a run with limbs of `limb_digits` digits.
+struct SpigotRunShape {
+    uint32_t base;
+    size_t len;
+    long long sweeps;
+
+    SpigotRunShape(long long n, int limb_digits) {
+        if (limb_digits < 1 || limb_digits > 9) {
+            throw std::invalid_argument("limb_digits must be between 1 and 9");
+        }
+        base = 1;
+        for (int k = 0; k < limb_digits; ++k) {
+            base *= 10;
+        }
+        long long limbs_swept = (n + limb_digits - 1) / limb_digits +
+                                (SPIGOT_SPARE_DIGITS + limb_digits - 1) / limb_digits;
+        len = spigotStateLength(limbs_swept * limb_digits);
+        sweeps = limbs_swept + 1;
+    }
+
+    size_t stateBytes() const {
+        if (spigotStateFits<uint16_t>(len, base)) {
+            return sizeof(uint16_t);
+        }
+        return spigotStateFits<uint32_t>(len, base) ? sizeof(uint32_t) : sizeof(uint64_t);
+    }
+};
+
+void streamPiDigitsSpigot(long long n, const SpigotOptions& options, const DigitSink& sink) {
+    if (n <= 0) {
+        sink("3.", 2);
+        return;
+    }
+    int limb_digits = options.limb_digits;
+    SpigotRunShape shape(n, limb_digits);
+    uint32_t base = shape.base;
+    size_t len = shape.len;
+    long long sweeps = shape.sweeps;
+
+    if (spigotStateFits<uint16_t>(len, base)) {
+        runSpigotWithState<uint16_t>(len, base, sweeps, limb_digits, n, options, sink);
+    }
+    else if (spigotStateFits<uint32_t>(len, base)) {
+        runSpigotWithState<uint32_t>(len, base, sweeps, limb_digits, n, options, sink);
+    }
+    else {
+        runSpigotWithState<uint64_t>(len, base, sweeps, limb_digits, n, options, sink);
+    }
+}
+
+std::string calculatePiDigitsSpigot(long long n, const SpigotOptions& options) {
+    std::string result;
+    result.reserve(static_cast<size_t>(std::max(n, 0LL)) + 2);
+    streamPiDigitsSpigot(n, options, [&result](const char* digits, size_t count) {
+        result.append(digits, count);
+    });
+    return result;
+}
+
+/*
+* =======================================================================================
+* Work-Stealing Task Scheduler
+* =======================================================================================
+*
+* Fork-join parallelism for recursive algorithms(binary splitting). A `TaskScheduler`
+* owns `threads - 1` worker threads. The thread that constructs it is worker 0 and must
+* be the one that uses it, until the scheduler is destroyed.
+* - Every worker has its own deque. `TaskGroup::spawn` pushes onto the back of the
+*   calling worker's deque, and a worker runs its own tasks newest first from the back.
+*   An idle worker steals the oldest task from the front of another deque; that is the
+*   largest remaining subtree and keeps steals rare.
+* - `TaskGroup::wait` does not block while the group has tasks outstanding; it keeps
+*   running tasks(its own first, then stolen ones). Nested groups therefore never
+*   deadlock, and the waiting thread does useful work.
+* - The first exception thrown by a task of a group is rethrown by its `wait`.
+* - `TaskScheduler::current()` is the scheduler the calling thread works for(null
+*   outside one). `parallelFor` uses it when present, so the loops nested inside tasks
+*   share the same workers instead of starting threads of their own.
+* Callers decide what is worth spawning, typically with a depth or size cutoff; a
+* spawn costs a heap allocation and a mutex round trip.
+*/
+class TaskGroup;
+
+class TaskScheduler {
+public:
+    explicit TaskScheduler(unsigned threads)
+        : queues(std::max(1u, threads)), queued(0), stopping(false),
+          previous(currentScheduler()), previous_index(workerIndex()) {
+        currentScheduler() = this;
+        workerIndex() = 0;
+        for (size_t worker = 1; worker < queues.size(); ++worker) {
+            workers.push_back(std::thread([this, worker]() { workerLoop(worker); }));
+        }
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+        currentScheduler() = previous;
+        workerIndex() = previous_index;
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    static TaskScheduler* current() { return currentScheduler(); }
+
+    unsigned threadCount() const { return static_cast<unsigned>(queues.size()); }
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> body;
+        TaskGroup* group;
+    };
+
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    static TaskScheduler*& currentScheduler() {
+        static thread_local TaskScheduler* scheduler = nullptr;
+        return scheduler;
+    }
+
+    static size_t& workerIndex() {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    void push(Task* task) {
+        // Counted before it is visible, so a thief never decrements below zero.
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            ++queued;
+        }
+        WorkerQueue& queue = queues[workerIndex()];
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.push_back(task);
+        }
+        wake.notify_one();
+    }
+
+    // Takes the newest task of this worker, else the oldest task of another one.
+    Task* take() {
+        size_t self = workerIndex();
+        for (size_t k = 0; k < queues.size(); ++k) {
+            WorkerQueue& queue = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (!queue.tasks.empty()) {
+                Task* task;
+                if (k == 0) {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                }
+                else {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+                std::lock_guard<std::mutex> sleep_guard(sleep_lock);
+                --queued;
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    bool runOne();
+
+    void workerLoop(size_t worker) {
+        currentScheduler() = this;
+        workerIndex() = worker;
+        for (;;) {
+            if (runOne()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [this]() { return stopping || queued > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    std::vector<WorkerQueue> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    size_t queued;  // tasks in all deques, guarded by sleep_lock
+    bool stopping;
+    TaskScheduler* previous;
+    size_t previous_index;
+};
+
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler& scheduler) : scheduler(scheduler), pending(0), failed(false) {}
+
+    // Waits for the outstanding tasks; their exceptions are dropped here.
+    ~TaskGroup() {
+        try {
+            wait();
+        }
+        catch (...) {
+        }
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void spawn(std::function<void()> body) {
+        std::unique_ptr<TaskScheduler::Task> task(new TaskScheduler::Task());
+        task->body = std::move(body);
+        task->group = this;
+        pending.fetch_add(1);
+        scheduler.push(task.release());
+    }
+
+    // Runs tasks until every task spawned into this group has finished.
+    void wait() {
+        while (pending.load() > 0) {
+            if (!scheduler.runOne()) {
+                std::this_thread::yield();
+            }
+        }
+        if (failed.exchange(false)) {
+            std::exception_ptr error = failure;
+            failure = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    friend class TaskScheduler;
+
+    void finish(std::exception_ptr error) {
+        if (error && !failed.exchange(true)) {
+            failure = error;
+        }
+        pending.fetch_sub(1);
+    }
+
+    TaskScheduler& scheduler;
+    std::atomic<size_t> pending;
+    std::atomic<bool> failed;
+    std::exception_ptr failure;
+};
+
+inline bool TaskScheduler::runOne() {
+    std::unique_ptr<Task> task(take());
+    if (!task) {
+        return false;
+    }
+    std::exception_ptr error;
+    try {
+        task->body();
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    task->group->finish(error);
+    return true;
+}
+
+// Runs body(0) ... body(count - 1) on `threads` threads that take indices from a shared
+// counter; the first exception thrown by any body is rethrown on the calling thread.
+// Inside a `TaskScheduler` the helpers are tasks of that scheduler, not new threads.
+void parallelFor(size_t count, unsigned threads, const std::function<void(size_t)>& body) {
+    std::atomic<size_t> next(0);
+    std::exception_ptr failure;
+    std::atomic<bool> failed(false);
+    auto worker = [&]() {
+        try {
+            for (size_t index = next++; index < count && !failed; index = next++) {
+                body(index);
+            }
+        }
+        catch (...) {
+            if (!failed.exchange(true)) {
+                failure = std::current_exception();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(std::max(1u, threads), count);
+    if (TaskScheduler* scheduler = TaskScheduler::current()) {
+        TaskGroup group(*scheduler);
+        for (size_t t = 1; t < helpers; ++t) {
+            group.spawn(worker);
+        }
+        worker();
+        group.wait();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+        return;
+    }
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < helpers; ++t) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < pool.size(); ++t) {
+        pool[t].join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+/*
+* =======================================================================================
+* Number-Theoretic Transform Multiplication
+* =======================================================================================
+*
+* Large products are computed as a cyclic convolution of the base 2^32 limbs modulo
+* three NTT-friendly primes(`NttPrime`), p = c * 2^k + 1 with primitive root g:
+*     2013265921 = 15 * 2^27 + 1(g = 31), 469762049 = 7 * 2^26 + 1(g = 3),
+*     167772161 = 5 * 2^25 + 1(g = 3).
+* Each convolution coefficient is below min(na, nb) * 2^64, which is below the product
+* of the primes(about 2^86.7) while the shorter operand has fewer than
+* `NTT_MAX_SHORT_LIMBS` limbs. Garner's algorithm rebuilds every coefficient from its
+* three residues and the carries are propagated into 32-bit limbs. The transform
+* length is limited to 2^25 by the smallest prime; `nttSupports` reports whether a
+* product fits so the caller can fall back to Toom-3 otherwise.
+* - The forward transform is decimation in frequency(natural order in, bit-reversed
+*   out) and the inverse is decimation in time(bit-reversed in, natural out), so no
+*   bit-reversal permutation is needed for the pointwise product.
+* - Twiddles: `NttPrime::tables(n)` keeps one table per direction per prime, holding
+*   w_{2h}^j at index h + j for every half-size h < n. It is grown on demand under a
+*   mutex and shared as a read-only `std::shared_ptr`, so every later transform of any
+*   size up to the cached one just reads it.
+* - Threads(`setMultiplyThreads`): the three primes run concurrently, and transforms of
+*   at least `NTT_PARALLEL_MIN` points also split every butterfly stage into chunks of
+*   `NTT_PARALLEL_CHUNK` butterflies over the remaining threads.
+* - Reduction: every product modulo P on the transform path is a Montgomery product
+*   `montgomery(a, b)` = a * b / 2^32 mod P(two multiplications and a shift, no
+*   division), with -1/P mod 2^32 a compile-time constant. The twiddles are stored
+*   multiplied by 2^32, so a butterfly's product a * w comes out in normal form; the
+*   2^32 lost by the pointwise products is restored by the inverse transform's final
+*   scaling by 2^64 / n. Only the table building and `pow` still divide(`mul`).
+*/
+const size_t NTT_MAX_LENGTH = size_t(1) << 25;
+const size_t NTT_MAX_SHORT_LIMBS = size_t(1) << 22;
+const size_t NTT_PARALLEL_MIN = size_t(1) << 16;
+const size_t NTT_PARALLEL_CHUNK = size_t(1) << 14;
+
+std::atomic<unsigned>& multiplyThreadsSetting() {
+    static std::atomic<unsigned> threads(1);
+    return threads;
+}
+
+// Threads used by every large big-integer multiplication from now on.
+void setMultiplyThreads(unsigned threads) {
+    multiplyThreadsSetting().store(std::max(1u, threads));
+}
+
+struct NttTables {
+    size_t size;
+    std::vector<uint32_t> forward;
+    std::vector<uint32_t> inverse;
+};
+
+// 1/p mod 2^32 for odd p by Newton's iteration from x = p, which is correct modulo 8;
+// each step doubles the number of correct low bits(3, 6, 12, 24, 48).
+constexpr uint32_t nttInverse32(uint32_t p, uint32_t x, int steps) {
+    return steps == 0 ? x : nttInverse32(p, x * (2u - p * x), steps - 1);
+}
+
+template <uint32_t P, uint32_t G>
+struct NttPrime {
+    static constexpr uint32_t MINUS_P_INVERSE = 0u - nttInverse32(P, P, 4);                          // -1/P mod 2^32
+    static constexpr uint32_t R1 = static_cast<uint32_t>((uint64_t(1) << 32) % P);              // 2^32 mod P
+    static constexpr uint32_t R2 = static_cast<uint32_t>(static_cast<uint64_t>(R1) * R1 % P);  // 2^64 mod P
+    static_assert(static_cast<uint32_t>(P * nttInverse32(P, P, 4)) == 1u, "nttInverse32 inverts P");
+
+
+    static uint32_t add(uint32_t a, uint32_t b) {
+        uint32_t sum = a + b;
+        return (sum >= P) ? sum - P : sum;
+    }
+
+    static uint32_t sub(uint32_t a, uint32_t b) { return (a >= b) ? a - b : a + P - b; }
+
+    static uint32_t mul(uint32_t a, uint32_t b) { return static_cast<uint32_t>(static_cast<uint64_t>(a) * b % P); }
+
+    // a * b / 2^32 mod P; needs a * b < P * 2^32, which holds when either factor is below P.
+    static uint32_t montgomery(uint32_t a, uint32_t b) {
+        uint64_t product = static_cast<uint64_t>(a) * b;
+        uint32_t m = static_cast<uint32_t>(product) * MINUS_P_INVERSE;
+        uint32_t t = static_cast<uint32_t>((product + static_cast<uint64_t>(m) * P) >> 32);
+        return (t >= P) ? t - P : t;
+    }
+
+    // a mod P for any 32-bit a.
+    static uint32_t reduce(uint32_t a) { return montgomery(a, R1); }
+
+    // a * 2^32 mod P: the factor that makes montgomery(x, toMontgomery(a)) = x * a mod P.
+    static uint32_t toMontgomery(uint32_t a) { return montgomery(a, R2); }
+
+    static uint32_t pow(uint32_t base, uint64_t exponent) {
+        uint32_t result = 1;
+        while (exponent > 0) {
+            if (exponent & 1) {
+                result = mul(result, base);
+            }
+            base = mul(base, base);
+            exponent >>= 1;
+        }
+        return result;
+    }
+
+    static std::shared_ptr<const NttTables> tables(size_t n) {
+        static std::mutex mutex;
+        static std::shared_ptr<const NttTables> cached;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!cached || cached->size < n) {
+            std::shared_ptr<NttTables> built(new NttTables());
+            built->size = n;
+            built->forward.resize(n);
+            built->inverse.resize(n);
+            for (size_t half = 1; half < n; half <<= 1) {
+                uint32_t w = pow(G, (P - 1) / (2 * half));
+                uint32_t w_inverse = pow(w, P - 2);
+                uint32_t power = 1, power_inverse = 1;
+                for (size_t j = 0; j < half; ++j) {
+                    built->forward[half + j] = toMontgomery(power);
+                    built->inverse[half + j] = toMontgomery(power_inverse);
+                    power = mul(power, w);
+                    power_inverse = mul(power_inverse, w_inverse);
+                }
+            }
+            cached = built;
+        }
+        return cached;
+    }
+
+    // Butterflies [begin, end) of the stage with half-size `half`.
+    static void stage(uint32_t* a, const uint32_t* roots, size_t half, size_t begin, size_t end, bool inverse) {
+        for (size_t t = begin; t < end;) {
+            size_t j = t % half;
+            size_t count = std::min(end - t, half - j);
+            uint32_t* x = a + (t / half) * 2 * half + j;
+            uint32_t* y = x + half;
+            const uint32_t* w = roots + half + j;
+            if (inverse) {
+                for (size_t k = 0; k < count; ++k) {
+                    uint32_t u = x[k], v = montgomery(y[k], w[k]);
+                    x[k] = add(u, v);
+                    y[k] = sub(u, v);
+                }
+            }
+            else {
+                for (size_t k = 0; k < count; ++k) {
+                    uint32_t u = x[k], v = y[k];
+                    x[k] = add(u, v);
+                    y[k] = montgomery(sub(u, v), w[k]);
+                }
+            }
+            t += count;
+        }
+    }
+
+    static void transform(std::vector<uint32_t>& a, bool inverse, unsigned threads) {
+        size_t n = a.size();
+        std::shared_ptr<const NttTables> table = tables(n);
+        const uint32_t* roots = inverse ? table->inverse.data() : table->forward.data();
+        size_t butterflies = n / 2;
+        bool parallel = threads > 1 && n >= NTT_PARALLEL_MIN;
+        for (size_t half = inverse ? 1 : n / 2; half >= 1 && half < n;) {
+            if (parallel) {
+                size_t chunks = (butterflies + NTT_PARALLEL_CHUNK - 1) / NTT_PARALLEL_CHUNK;
+                parallelFor(chunks, threads, [&](size_t chunk) {
+                    size_t begin = chunk * NTT_PARALLEL_CHUNK;
+                    stage(a.data(), roots, half, begin, std::min(butterflies, begin + NTT_PARALLEL_CHUNK), inverse);
+                });
+            }
+            else {
+                stage(a.data(), roots, half, 0, butterflies, inverse);
+            }
+            half = inverse ? half * 2 : half / 2;
+        }
+        if (inverse) {
+            // 2^64 / n: undoes the 1 / 2^32 of the pointwise products and the 1 / 2^32 of
+            // this product as well as the factor n of the transform pair.
+            uint32_t scale = mul(R2, pow(static_cast<uint32_t>(n % P), P - 2));
+            for (size_t i = 0; i < n; ++i) {
+                a[i] = montgomery(a[i], scale);
+            }
+        }
+    }
+
+    // The cyclic convolution of a and b modulo P, of length n(in normal form).
+    static std::vector<uint32_t> convolve(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, size_t n,
+                                          unsigned threads) {
+        std::vector<uint32_t> fa(n, 0);
+        for (size_t i = 0; i < na; ++i) {
+            fa[i] = reduce(a[i]);
+        }
+        transform(fa, false, threads);
+        if (a == b && na == nb) {
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] = montgomery(fa[i], fa[i]);
+            }
+        }
+        else {
+            std::vector<uint32_t> fb(n, 0);
+            for (size_t i = 0; i < nb; ++i) {
+                fb[i] = reduce(b[i]);
+            }
+            transform(fb, false, threads);
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] = montgomery(fa[i], fb[i]);
+            }
+        }
+        transform(fa, true, threads);
+        return fa;
+    }
+};
+
+typedef NttPrime<2013265921u, 31u> NttPrime1;
+typedef NttPrime<469762049u, 3u> NttPrime2;
+typedef NttPrime<167772161u, 3u> NttPrime3;
+
+bool nttSupports(size_t na, size_t nb) {
+    return std::min(na, nb) < NTT_MAX_SHORT_LIMBS && na + nb <= NTT_MAX_LENGTH;
+}
+
+// Writes the na + nb limb product of two little-endian base 2^32 magnitudes to `result`.
+void nttMultiply(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* result) {
+    size_t n = 1;
+    while (n < na + nb - 1) {
+        n <<= 1;
+    }
+    unsigned threads = multiplyThreadsSetting().load();
+    unsigned inner = std::max(1u, threads / 3);
+    std::vector<uint32_t> residues[3];
+    parallelFor(3, threads, [&](size_t prime) {
+        if (prime == 0) {
+            residues[0] = NttPrime1::convolve(a, na, b, nb, n, inner);
+        }
+        else if (prime == 1) {
+            residues[1] = NttPrime2::convolve(a, na, b, nb, n, inner);
+        }
+        else {
+            residues[2] = NttPrime3::convolve(a, na, b, nb, n, inner);
+        }
+    });
+
+    // Garner's constants as Montgomery factors, so every step is a Montgomery product.
+    const uint64_t p1 = 2013265921u, p2 = 469762049u, p3 = 167772161u;
+    const uint32_t inverse_p1_mod_p2 = NttPrime2::toMontgomery(NttPrime2::pow(static_cast<uint32_t>(p1 % p2), p2 - 2));
+    const uint32_t p1_mod_p3 = NttPrime3::toMontgomery(static_cast<uint32_t>(p1 % p3));
+    const uint32_t inverse_p1p2_mod_p3 =
+        NttPrime3::toMontgomery(NttPrime3::pow(NttPrime3::mul(p1 % p3, p2 % p3), p3 - 2));
+
+    uint64_t carry_low = 0, carry_high = 0;  // running 128-bit carry
+    for (size_t i = 0; i < na + nb; ++i) {
+        if (i < na + nb - 1) {
+            uint32_t t1 = residues[0][i];
+            uint32_t t2 = NttPrime2::montgomery(NttPrime2::sub(residues[1][i], NttPrime2::reduce(t1)),
+                                                inverse_p1_mod_p2);
+            uint32_t partial = NttPrime3::add(NttPrime3::reduce(t1), NttPrime3::montgomery(t2, p1_mod_p3));
+            uint32_t t3 = NttPrime3::montgomery(NttPrime3::sub(residues[2][i], partial), inverse_p1p2_mod_p3);
+            uint64_t v = t2 + p2 * t3;
+            uint64_t low = p1 * v;
+            uint64_t high = mulHigh64(p1, v);
+            low += t1;
+            high += (low < t1) ? 1 : 0;
+            carry_low += low;
+            carry_high += high + ((carry_low < low) ? 1 : 0);
+        }
+        result[i] = static_cast<uint32_t>(carry_low);
+        carry_low = (carry_low >> 32) | (carry_high << 32);
+        carry_high >>= 32;
+    }
+}
+
+/*
+* =======================================================================================
+* Limb Arena
+* =======================================================================================
+*
+* Binary splitting creates and destroys a very large number of small BigInt limb
+* vectors. `LimbArena` is a per-thread bump allocator that `LimbAllocator`(the
+* allocator of `BigInt::Limbs`) uses while a `LimbArenaScope` is open on the thread:
+* - Memory comes from chunks of at least `LIMB_ARENA_CHUNK` bytes that are kept for
+*   the lifetime of the thread, so after the first subtree no chunk is requested from
+*   the heap again and the pages are already faulted in.
+* - Freeing the most recent block pops it, so stack-like temporaries(Karatsuba and
+*   Toom-3 intermediates) are reused immediately; any other free is a no-op.
+* - Closing the scope rewinds the arena to where the scope began. The next scope on the
+*   same thread, typically the sibling subtree, reuses the same memory.
+* Every block carries a 16-byte header naming its arena, or null for heap blocks, so a
+* vector allocated inside a scope can still be destroyed after it.
+* Values that outlive a scope must be copied out under `LimbArenaSuspend`, which routes
+* allocations to the heap again. The arena must not be rewound under live blocks, and
+* arena blocks must not be handed to another thread.
+*/
+const size_t LIMB_ARENA_CHUNK = size_t(1) << 20;
+const size_t LIMB_ARENA_HEADER = 16;
+
+class LimbArena {
+public:
+    struct Mark {
+        size_t chunk;
+        size_t used;
+    };
+
+    LimbArena() : current_chunk(0), used(0) {}
+
+    LimbArena(const LimbArena&) = delete;
+    LimbArena& operator=(const LimbArena&) = delete;
+
+    // The arena of the calling thread(created on first use).
+    static LimbArena& local() {
+        static thread_local LimbArena arena;
+        return arena;
+    }
+
+    // The arena that allocations of the calling thread go to, or null for the heap.
+    static LimbArena*& active() {
+        static thread_local LimbArena* arena = nullptr;
+        return arena;
+    }
+
+    void* allocate(size_t bytes) {
+        bytes = (bytes + LIMB_ARENA_HEADER - 1) / LIMB_ARENA_HEADER * LIMB_ARENA_HEADER;
+        while (current_chunk < chunks.size() && used + bytes > chunks[current_chunk].size) {
+            ++current_chunk;
+            used = 0;
+        }
+        if (current_chunk == chunks.size()) {
+            Chunk chunk;
+            chunk.size = std::max(bytes, LIMB_ARENA_CHUNK);
+            chunk.memory.reset(new char[chunk.size]);
+            chunks.push_back(std::move(chunk));
+            used = 0;
+        }
+        void* block = chunks[current_chunk].memory.get() + used;
+        used += bytes;
+        return block;
+    }
+
+    // Pops `block` if it is the most recent allocation of the current chunk.
+    void release(void* block, size_t bytes) {
+        bytes = (bytes + LIMB_ARENA_HEADER - 1) / LIMB_ARENA_HEADER * LIMB_ARENA_HEADER;
+        if (current_chunk < chunks.size() && used >= bytes &&
+            static_cast<char*>(block) == chunks[current_chunk].memory.get() + used - bytes) {
+            used -= bytes;
+        }
+    }
+
+    Mark mark() const {
+        Mark position = { current_chunk, used };
+        return position;
+    }
+
+    void rewind(Mark position) {
+        current_chunk = position.chunk;
+        used = position.used;
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current_chunk;
+    size_t used;
+};
+
+// Directs the limb allocations of this thread into its arena until destroyed, then
+// rewinds the arena. Scopes nest; an inner scope only releases its own allocations.
+class LimbArenaScope {
+public:
+    LimbArenaScope() : arena(LimbArena::local()), start(arena.mark()), previous(LimbArena::active()) {
+        LimbArena::active() = &arena;
+    }
+
+    ~LimbArenaScope() {
+        arena.rewind(start);
+        LimbArena::active() = previous;
+    }
+
+    LimbArenaScope(const LimbArenaScope&) = delete;
+    LimbArenaScope& operator=(const LimbArenaScope&) = delete;
+
+private:
+    LimbArena& arena;
+    LimbArena::Mark start;
+    LimbArena* previous;
+};
+
+// Sends the limb allocations of this thread to the heap until destroyed.
+class LimbArenaSuspend {
+public:
+    LimbArenaSuspend() : previous(LimbArena::active()) {
+        LimbArena::active() = nullptr;
+    }
+
+    ~LimbArenaSuspend() {
+        LimbArena::active() = previous;
+    }
+
+    LimbArenaSuspend(const LimbArenaSuspend&) = delete;
+    LimbArenaSuspend& operator=(const LimbArenaSuspend&) = delete;
+
+private:
+    LimbArena* previous;
+};
+
+template<typename T>
+struct LimbAllocator {
+    typedef T value_type;
+
+    LimbAllocator() {}
+
+    template<typename U>
+    LimbAllocator(const LimbAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        size_t bytes = LIMB_ARENA_HEADER + count * sizeof(T);
+        LimbArena* arena = LimbArena::active();
+        char* block = static_cast<char*>(arena ? arena->allocate(bytes) : ::operator new(bytes));
+        *reinterpret_cast<LimbArena**>(block) = arena;
+        return reinterpret_cast<T*>(block + LIMB_ARENA_HEADER);
+    }
+
+    void deallocate(T* values, size_t count) {
+        char* block = reinterpret_cast<char*>(values) - LIMB_ARENA_HEADER;
+        LimbArena* arena = *reinterpret_cast<LimbArena**>(block);
+        if (arena) {
+            arena->release(block, LIMB_ARENA_HEADER + count * sizeof(T));
+        }
+        else {
+            ::operator delete(block);
+        }
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const LimbAllocator<T>&, const LimbAllocator<U>&) {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const LimbAllocator<T>&, const LimbAllocator<U>&) {
+    return false;
+}
+
+/*
+* =======================================================================================
+* Arbitrary-Precision Integers(BigInt)
+* =======================================================================================
+*
+* A minimal signed big integer used by the high-precision engines. The magnitude is
+* stored little-endian in base 2^32 `limbs`(no leading zero limbs; zero is the empty
+* vector) with a separate `negative` flag.
+* - Multiplication: by the size of the shorter operand, schoolbook below
+*   `KARATSUBA_THRESHOLD` limbs, Karatsuba below `TOOM3_THRESHOLD`, Toom-3 below
+*   `NTT_THRESHOLD` and the three-prime NTT above it(`nttMultiply`, when the sizes fit).
+*   Unbalanced operands are split so that only balanced products reach Karatsuba and
+*   Toom-3. Toom-3 evaluates at 0, 1, -1, -2 and infinity and interpolates with
+*   Bodrato's sequence(two exact divisions, by 2 and by 3) on signed BigInts.
+* - Division: Newton iteration on a reciprocal(`reciprocal` returns floor(2^(2n)/b)
+*   for an n-bit `b`, doubling the precision at every recursion level), followed by
+*   an exact correction of the quotient. Single-limb divisors take a direct path.
+* - Square root: `isqrt` recurses on the top half of the bits and finishes with one
+*   Newton step plus an exact correction.
+* - Decimal output: `writeDecimalDigits` splits the value by 10^(9 * 2^k), using the
+*   powers and their reciprocals precomputed once per conversion, and writes the ASCII
+*   digits of the two halves straight into the caller's buffer(in parallel under a
+*   `TaskScheduler`). Below `DECIMAL_SPLIT_DIGITS` digits it divides by 10^9 repeatedly.
+*   Both directions therefore run at the speed of the multiply. Decimal input(`fromDecimalString`) splits the digits in
+*   halves, high * 10^(low digits) + low.
+* - Persistence: `writeBinary`/`readBinary` store the sign, the limb count and the raw
+*   limbs in native byte order.
+* - Memory: `Limbs` allocates through `LimbAllocator`, so inside a `LimbArenaScope` the
+*   limbs(and every temporary of the arithmetic) come from the thread's limb arena.
+* Division, square root and the shift operators are only defined for non-negative
+* values, which is all the engines need.
+*/
+class BigInt {
+public:
+    typedef std::vector<uint32_t, LimbAllocator<uint32_t> > Limbs;
+
+    BigInt() : negative(false) {}
+
+    BigInt(long long value) : negative(value < 0) {
+        unsigned long long magnitude = negative ? 0ULL - static_cast<unsigned long long>(value)
+                                                : static_cast<unsigned long long>(value);
+        setMagnitude(magnitude);
+    }
+
+    static BigInt fromUnsigned(unsigned long long value) {
+        BigInt result;
+        result.setMagnitude(value);
+        return result;
+    }
+
+    static BigInt pow(uint32_t base, unsigned long long exponent) {
+        BigInt result = 1;
+        BigInt square = fromUnsigned(base);
+        while (exponent > 0) {
+            if (exponent & 1) {
+                result *= square;
+            }
+            exponent >>= 1;
+            if (exponent > 0) {
+                square *= square;
+            }
+        }
+        return result;
+    }
+
+    bool isZero() const { return limbs.empty(); }
+    bool isNegative() const { return negative; }
+
+    size_t bitLength() const {
+        if (limbs.empty()) {
+            return 0;
+        }
+        size_t bits = (limbs.size() - 1) * 32;
+        uint32_t top = limbs.back();
+        while (top != 0) {
+            ++bits;
+            top >>= 1;
+        }
+        return bits;
+    }
+
+    BigInt operator-() const {
+        BigInt result = *this;
+        if (!result.isZero()) {
+            result.negative = !result.negative;
+        }
+        return result;
+    }
+
+    BigInt& operator+=(const BigInt& other) {
+        addSigned(other, other.negative);
+        return *this;
+    }
+
+    BigInt& operator-=(const BigInt& other) {
+        addSigned(other, !other.negative);
+        return *this;
+    }
+
+    BigInt& operator*=(const BigInt& other) {
+        limbs = mulMagnitude(limbs, other.limbs);
+        negative = !limbs.empty() && (negative != other.negative);
+        return *this;
+    }
+
+    BigInt& operator<<=(size_t bits) {
+        limbs = shiftLeftMagnitude(limbs, bits);
+        return *this;
+    }
+
+    BigInt& operator>>=(size_t bits) {
+        limbs = shiftRightMagnitude(limbs, bits);
+        if (limbs.empty()) {
+            negative = false;
+        }
+        return *this;
+    }
+
+    friend BigInt operator+(BigInt a, const BigInt& b) { return a += b; }
+    friend BigInt operator-(BigInt a, const BigInt& b) { return a -= b; }
+    friend BigInt operator*(BigInt a, const BigInt& b) { return a *= b; }
+    friend BigInt operator<<(BigInt a, size_t bits) { return a <<= bits; }
+    friend BigInt operator>>(BigInt a, size_t bits) { return a >>= bits; }
+
+    friend int compare(const BigInt& a, const BigInt& b) {
+        if (a.negative != b.negative) {
+            return a.negative ? -1 : 1;
+        }
+        int magnitude = compareMagnitude(a.limbs, b.limbs);
+        return a.negative ? -magnitude : magnitude;
+    }
+
+    friend bool operator<(const BigInt& a, const BigInt& b) { return compare(a, b) < 0; }
+    friend bool operator>(const BigInt& a, const BigInt& b) { return compare(a, b) > 0; }
+    friend bool operator<=(const BigInt& a, const BigInt& b) { return compare(a, b) <= 0; }
+    friend bool operator>=(const BigInt& a, const BigInt& b) { return compare(a, b) >= 0; }
+    friend bool operator==(const BigInt& a, const BigInt& b) { return compare(a, b) == 0; }
+    friend bool operator!=(const BigInt& a, const BigInt& b) { return compare(a, b) != 0; }
+
+    // Divides in place by a single word and returns the remainder.
+    uint32_t divmodSmall(uint32_t divisor) {
+        uint64_t remainder = 0;
+        for (size_t i = limbs.size(); i-- > 0;) {
+            uint64_t current = (remainder << 32) | limbs[i];
+            limbs[i] = static_cast<uint32_t>(current / divisor);
+            remainder = current % divisor;
+        }
+        trim(limbs);
+        if (limbs.empty()) {
+            negative = false;
+        }
+        return static_cast<uint32_t>(remainder);
+    }
+
+    // floor(a / b) for a >= 0, b > 0.
+    static BigInt divide(const BigInt& a, const BigInt& b) {
+        if (b.isZero()) {
+            throw std::domain_error("BigInt division by zero");
+        }
+        if (compareMagnitude(a.limbs, b.limbs) < 0) {
+            return BigInt();
+        }
+        if (b.limbs.size() == 1) {
+            BigInt quotient = a;
+            quotient.divmodSmall(b.limbs[0]);
+            return quotient;
+        }
+
+        size_t n = b.bitLength();
+        size_t m = a.bitLength();
+        size_t scale = (m > 2 * n) ? m - 2 * n : 0;
+        BigInt inverse = reciprocal(b << scale);
+        BigInt quotient = (a * inverse) >> (2 * n + scale);
+
+        BigInt remainder = a - quotient * b;
+        while (remainder.isNegative()) {
+            quotient -= 1;
+            remainder += b;
+        }
+        while (remainder >= b) {
+            quotient += 1;
+            remainder -= b;
+        }
+        return quotient;
+    }
+
+    // floor(sqrt(value)) for value >= 0.
+    static BigInt isqrt(const BigInt& value) {
+        size_t bits = value.bitLength();
+        if (bits <= 52) {
+            unsigned long long v = value.toUnsigned();
+            unsigned long long root = static_cast<unsigned long long>(std::sqrt(static_cast<double>(v)));
+            while (root * root > v) --root;
+            while ((root + 1) * (root + 1) <= v) ++root;
+            return fromUnsigned(root);
+        }
+
+        size_t shift = 2 * (bits / 4);
+        BigInt root = isqrt(value >> shift) << (shift / 2);
+        root = (root + divide(value, root)) >> 1;
+
+        BigInt square = root * root;
+        while (square > value) {
+            square -= (root << 1) - 1;
+            root -= 1;
+        }
+        while (square + (root << 1) + 1 <= value) {
+            square += (root << 1) + 1;
+            root += 1;
+        }
+        return root;
+    }
+
+    // The low 64 bits of the magnitude.
+    unsigned long long lowBits() const { return toUnsigned(); }
+
+    // The value of `count` decimal digits(most significant first, digits only).
+    static BigInt fromDecimalString(const char* digits, size_t count) {
+        std::vector<std::pair<size_t, BigInt> > powers;
+        return fromDecimalRange(digits, count, powers);
+    }
+
+    // Exactly `width` decimal digits of the magnitude, zero padded on the left, into
+    // `out`(no terminator). The magnitude must be below 10^width.
+    void writeDecimalDigits(char* out, size_t width) const {
+        std::vector<BigInt> powers, inverses;
+        decimalPowers(width, powers, inverses);
+        writeDecimalRange(*this, out, width, powers, inverses);
+    }
+
+    std::string toDecimalString() const {
+        if (limbs.empty()) {
+            return "0";
+        }
+        // log10(2) * bits rounded up, plus one digit of slack for the rounding.
+        size_t width = static_cast<size_t>(static_cast<double>(bitLength()) * 0.30102999566398120) + 2;
+        std::string result(width, '0');
+        writeDecimalDigits(&result[0], width);
+        result.erase(0, result.find_first_not_of('0'));
+        if (negative) {
+            result.insert(0, 1, '-');
+        }
+        return result;
+    }
+
+    void writeBinary(std::ostream& out) const {
+        uint64_t count = limbs.size();
+        char sign = negative ? 1 : 0;
+        out.write(&sign, 1);
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        if (count > 0) {
+            out.write(reinterpret_cast<const char*>(limbs.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+        }
+    }
+
+    // Refuses more than `max_limbs` limbs as corrupt.
+    static BigInt readBinary(std::istream& in, uint64_t max_limbs = 1ULL << 40) {
+        char sign = 0;
+        uint64_t count = 0;
+        in.read(&sign, 1);
+        in.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!in || count > max_limbs) {
+            throw std::runtime_error("BigInt::readBinary: truncated or corrupt input");
+        }
+        BigInt result;
+        result.limbs.resize(static_cast<size_t>(count));
+        if (count > 0) {
+            in.read(reinterpret_cast<char*>(result.limbs.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+        }
+        if (!in) {
+            throw std::runtime_error("BigInt::readBinary: truncated or corrupt input");
+        }
+        trim(result.limbs);
+        result.negative = (sign != 0) && !result.limbs.empty();
+        return result;
+    }
+
+private:
+    static const size_t KARATSUBA_THRESHOLD = 32;
+    static const size_t TOOM3_THRESHOLD = 160;
+    static const size_t NTT_THRESHOLD = 1024;
+    static const size_t DECIMAL_SPLIT_DIGITS = 2000;
+    static const size_t DECIMAL_PARALLEL_DIGITS = 1 << 16;
+
+    Limbs limbs;
+    bool negative;
+
+    void setMagnitude(unsigned long long magnitude) {
+        limbs.clear();
+        while (magnitude != 0) {
+            limbs.push_back(static_cast<uint32_t>(magnitude));
+            magnitude >>= 32;
+        }
+    }
+
+    unsigned long long toUnsigned() const {
+        unsigned long long result = 0;
+        for (size_t i = std::min<size_t>(limbs.size(), 2); i-- > 0;) {
+            result = (result << 32) | limbs[i];
+        }
+        return result;
+    }
+
+    void addSigned(const BigInt& other, bool other_negative) {
+        if (negative == other_negative) {
+            limbs = addMagnitude(limbs, other.limbs);
+            negative = other_negative;
+        }
+        else if (compareMagnitude(limbs, other.limbs) >= 0) {
+            limbs = subMagnitude(limbs, other.limbs);
+        }
+        else {
+            limbs = subMagnitude(other.limbs, limbs);
+            negative = other_negative;
+        }
+        if (limbs.empty()) {
+            negative = false;
+        }
+    }
+
+    // floor(2^(2n) / b) for an n-bit b > 0.
+    static BigInt reciprocal(const BigInt& b) {
+        size_t n = b.bitLength();
+        if (n <= 31) {
+            return fromUnsigned((1ULL << (2 * n)) / b.limbs[0]);
+        }
+
+        size_t k = n / 2 + 1;
+        BigInt x = reciprocal(b >> (n - k)) << (n - k);
+        x = (x << 1) - ((b * (x * x)) >> (2 * n));
+
+        BigInt target = BigInt(1) << (2 * n);
+        BigInt product = b * x;
+        while (product > target) {
+            x -= 1;
+            product -= b;
+        }
+        while (product + b <= target) {
+            x += 1;
+            product += b;
+        }
+        return x;
+    }
+
+    static void trim(Limbs& v) {
+        while (!v.empty() && v.back() == 0) {
+            v.pop_back();
+        }
+    }
+
+    static int compareMagnitude(const Limbs& a, const Limbs& b) {
+        if (a.size() != b.size()) {
+            return a.size() < b.size() ? -1 : 1;
+        }
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) {
+                return a[i] < b[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    static Limbs addMagnitude(const Limbs& a, const Limbs& b) {
+        const Limbs& longer = (a.size() >= b.size()) ? a : b;
+        const Limbs& shorter = (a.size() >= b.size()) ? b : a;
+        Limbs result(longer.size() + 1);
+        uint64_t carry = 0;
+        for (size_t i = 0; i < longer.size(); ++i) {
+            uint64_t sum = static_cast<uint64_t>(longer[i]) + (i < shorter.size() ? shorter[i] : 0) + carry;
+            result[i] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        result[longer.size()] = static_cast<uint32_t>(carry);
+        trim(result);
+        return result;
+    }
+
+    // |a| - |b|, requires |a| >= |b|.
+    static Limbs subMagnitude(const Limbs& a, const Limbs& b) {
+        Limbs result(a.size());
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t subtrahend = (i < b.size() ? b[i] : 0) + borrow;
+            uint64_t minuend = a[i];
+            borrow = (minuend < subtrahend) ? 1 : 0;
+            result[i] = static_cast<uint32_t>(minuend + (borrow << 32) - subtrahend);
+        }
+        trim(result);
+        return result;
+    }
+
+    // result += value * 2^(32 * offset)
+    static void addShiftedInPlace(Limbs& result, const Limbs& value, size_t offset) {
+        if (result.size() < offset + value.size() + 1) {
+            result.resize(offset + value.size() + 1, 0);
+        }
+        uint64_t carry = 0;
+        size_t i = 0;
+        for (; i < value.size(); ++i) {
+            uint64_t sum = static_cast<uint64_t>(result[offset + i]) + value[i] + carry;
+            result[offset + i] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        for (size_t k = offset + i; carry != 0; ++k) {
+            if (k == result.size()) {
+                result.push_back(0);
+            }
+            uint64_t sum = static_cast<uint64_t>(result[k]) + carry;
+            result[k] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        trim(result);
+    }
+
+    static Limbs lowPart(const Limbs& a, size_t count) {
+        Limbs result(a.begin(), a.begin() + std::min(count, a.size()));
+        trim(result);
+        return result;
+    }
+
+    static Limbs highPart(const Limbs& a, size_t count) {
+        if (count >= a.size()) {
+            return Limbs();
+        }
+        return Limbs(a.begin() + count, a.end());
+    }
+
+    // 10^exponent, kept in `powers` because the halves of one level share exponents.
+    static const BigInt& powerOfTen(size_t exponent, std::vector<std::pair<size_t, BigInt> >& powers) {
+        for (size_t i = 0; i < powers.size(); ++i) {
+            if (powers[i].first == exponent) {
+                return powers[i].second;
+            }
+        }
+        powers.push_back(std::make_pair(exponent, pow(10, exponent)));
+        return powers.back().second;
+    }
+
+    static BigInt fromDecimalRange(const char* digits, size_t count, std::vector<std::pair<size_t, BigInt> >& powers) {
+        if (count <= DECIMAL_SPLIT_DIGITS) {
+            BigInt result;
+            for (size_t start = 0; start < count;) {
+                size_t chunk = std::min<size_t>(9, count - start);
+                uint32_t value = 0, scale = 1;
+                for (size_t k = 0; k < chunk; ++k) {
+                    value = value * 10 + static_cast<uint32_t>(digits[start + k] - '0');
+                    scale *= 10;
+                }
+                result *= fromUnsigned(scale);
+                result += fromUnsigned(value);
+                start += chunk;
+            }
+            return result;
+        }
+        size_t low = count / 2;
+        BigInt high = fromDecimalRange(digits, count - low, powers);
+        high *= powerOfTen(low, powers);
+        return high + fromDecimalRange(digits + (count - low), low, powers);
+    }
+
+    // powers[k] = 10^(9 * 2^k) and inverses[k] = its `reciprocal`, for every level with
+    // 9 * 2^k < width. The inverses are independent and are computed as parallel tasks.
+    static void decimalPowers(size_t width, std::vector<BigInt>& powers, std::vector<BigInt>& inverses) {
+        powers.push_back(fromUnsigned(1000000000));
+        while ((static_cast<size_t>(9) << powers.size()) < width) {
+            powers.push_back(powers.back() * powers.back());
+        }
+        inverses.resize(powers.size());
+        TaskScheduler* scheduler = TaskScheduler::current();
+        if (scheduler && width >= DECIMAL_PARALLEL_DIGITS) {
+            TaskGroup group(*scheduler);
+            for (size_t k = 1; k < powers.size(); ++k) {
+                group.spawn([&powers, &inverses, k]() {
+                    LimbArenaSuspend heap;
+                    inverses[k] = reciprocal(powers[k]);
+                });
+            }
+            inverses[0] = reciprocal(powers[0]);
+            group.wait();
+        }
+        else {
+            for (size_t k = 0; k < powers.size(); ++k) {
+                inverses[k] = reciprocal(powers[k]);
+            }
+        }
+    }
+
+    // Writes `width` digits of `value` < 10^width: value = high * 10^low + low, where low
+    // is the largest 9 * 2^k digits below `width`, so high < 10^low and one Newton step
+    // with the precomputed inverse gives the split. The halves write disjoint parts of
+    // `out`; big ones run in parallel.
+    static void writeDecimalRange(const BigInt& value, char* out, size_t width,
+                                  const std::vector<BigInt>& powers, const std::vector<BigInt>& inverses) {
+        if (width <= DECIMAL_SPLIT_DIGITS) {
+            BigInt work = value;
+            work.negative = false;
+            for (size_t end = width; end > 0;) {
+                uint32_t chunk = work.isZero() ? 0 : work.divmodSmall(1000000000);
+                for (int k = 0; k < 9 && end > 0; ++k) {
+                    out[--end] = static_cast<char>('0' + chunk % 10);
+                    chunk /= 10;
+                }
+            }
+            return;
+        }
+        size_t level = 0;
+        while ((static_cast<size_t>(9) << (level + 1)) < width) {
+            ++level;
+        }
+        size_t low_width = static_cast<size_t>(9) << level;
+        const BigInt& power = powers[level];
+        size_t bits = power.bitLength();
+        BigInt high = (value * inverses[level]) >> (2 * bits);
+        high.negative = false;
+        BigInt low = value;
+        low.negative = false;
+        low -= high * power;
+        while (low.isNegative()) {
+            high -= 1;
+            low += power;
+        }
+        while (low >= power) {
+            high += 1;
+            low -= power;
+        }
+
+        TaskScheduler* scheduler = TaskScheduler::current();
+        if (scheduler && width >= DECIMAL_PARALLEL_DIGITS) {
+            TaskGroup group(*scheduler);
+            group.spawn([&]() {
+                LimbArenaSuspend heap;
+                writeDecimalRange(high, out, width - low_width, powers, inverses);
+            });
+            writeDecimalRange(low, out + (width - low_width), low_width, powers, inverses);
+            group.wait();
+        }
+        else {
+            writeDecimalRange(high, out, width - low_width, powers, inverses);
+            writeDecimalRange(low, out + (width - low_width), low_width, powers, inverses);
+        }
+    }
+
+    static Limbs mulSchoolbook(const Limbs& a, const Limbs& b) {
+        Limbs result(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t carry = 0;
+            uint64_t ai = a[i];
+            if (ai == 0) {
+                continue;
+            }
+            for (size_t j = 0; j < b.size(); ++j) {
+                uint64_t t = ai * b[j] + result[i + j] + carry;
+                result[i + j] = static_cast<uint32_t>(t);
+                carry = t >> 32;
+            }
+            result[i + b.size()] = static_cast<uint32_t>(carry);
+        }
+        trim(result);
+        return result;
+    }
+
+    static Limbs mulMagnitude(const Limbs& a, const Limbs& b) {
+        if (a.empty() || b.empty()) {
+            return Limbs();
+        }
+        if (a.size() < b.size()) {
+            return mulMagnitude(b, a);
+        }
+        if (b.size() < KARATSUBA_THRESHOLD) {
+            return mulSchoolbook(a, b);
+        }
+        if (b.size() >= NTT_THRESHOLD && nttSupports(a.size(), b.size())) {
+            Limbs result(a.size() + b.size());
+            nttMultiply(a.data(), a.size(), b.data(), b.size(), result.data());
+            trim(result);
+            return result;
+        }
+
+        size_t m = a.size() / 2;
+        Limbs a0 = lowPart(a, m);
+        Limbs a1 = highPart(a, m);
+        if (b.size() <= m) {
+            Limbs result = mulMagnitude(a0, b);
+            addShiftedInPlace(result, mulMagnitude(a1, b), m);
+            return result;
+        }
+
+        if (b.size() >= TOOM3_THRESHOLD) {
+            return mulToom3(a, b);
+        }
+
+        Limbs b0 = lowPart(b, m);
+        Limbs b1 = highPart(b, m);
+        Limbs z0 = mulMagnitude(a0, b0);
+        Limbs z2 = mulMagnitude(a1, b1);
+        Limbs z1 = mulMagnitude(addMagnitude(a0, a1), addMagnitude(b0, b1));
+        z1 = subMagnitude(subMagnitude(z1, z0), z2);
+
+        Limbs result = z0;
+        addShiftedInPlace(result, z1, m);
+        addShiftedInPlace(result, z2, 2 * m);
+        return result;
+    }
+
+    static BigInt fromLimbs(Limbs magnitude) {
+        BigInt result;
+        result.limbs.swap(magnitude);
+        trim(result.limbs);
+        return result;
+    }
+
+    // a = a0 + a1*X + a2*X^2 with X = 2^(32k) and k = ceil(|a| / 3); requires |b| > k.
+    static Limbs mulToom3(const Limbs& a, const Limbs& b) {
+        size_t k = (a.size() + 2) / 3;
+        BigInt a0 = fromLimbs(lowPart(a, k)), a1 = fromLimbs(lowPart(highPart(a, k), k)), a2 = fromLimbs(highPart(a, 2 * k));
+        BigInt b0 = fromLimbs(lowPart(b, k)), b1 = fromLimbs(lowPart(highPart(b, k), k)), b2 = fromLimbs(highPart(b, 2 * k));
+
+        BigInt a_sum = a0 + a2, b_sum = b0 + b2;
+        BigInt a_m1 = a_sum - a1, b_m1 = b_sum - b1;
+        BigInt a_m2 = ((a_m1 + a2) << 1) - a0, b_m2 = ((b_m1 + b2) << 1) - b0;
+        a_sum += a1;
+        b_sum += b1;
+
+        BigInt r0 = a0 * b0;
+        BigInt r1 = a_sum * b_sum;
+        BigInt r_m1 = a_m1 * b_m1;
+        BigInt r_m2 = a_m2 * b_m2;
+        BigInt r_inf = a2 * b2;
+
+        BigInt r3 = r_m2 - r1;
+        r3.divmodSmall(3);
+        r1 -= r_m1;
+        r1 >>= 1;
+        BigInt r2 = r_m1 - r0;
+        r3 = r2 - r3;
+        r3 >>= 1;
+        r3 += r_inf << 1;
+        r2 += r1;
+        r2 -= r_inf;
+        r1 -= r3;
+
+        Limbs result = r0.limbs;
+        addShiftedInPlace(result, r1.limbs, k);
+        addShiftedInPlace(result, r2.limbs, 2 * k);
+        addShiftedInPlace(result, r3.limbs, 3 * k);
+        addShiftedInPlace(result, r_inf.limbs, 4 * k);
+        return result;
+    }
+
+    static Limbs shiftLeftMagnitude(const Limbs& a, size_t bits) {
+        if (a.empty()) {
+            return Limbs();
+        }
+        size_t limb_shift = bits / 32;
+        unsigned bit_shift = static_cast<unsigned>(bits % 32);
+        Limbs result(a.size() + limb_shift + 1, 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t shifted = static_cast<uint64_t>(a[i]) << bit_shift;
+            result[i + limb_shift] |= static_cast<uint32_t>(shifted);
+            result[i + limb_shift + 1] |= static_cast<uint32_t>(shifted >> 32);
+        }
+        trim(result);
+        return result;
+    }
+
+    static Limbs shiftRightMagnitude(const Limbs& a, size_t bits) {
+        size_t limb_shift = bits / 32;
+        if (limb_shift >= a.size()) {
+            return Limbs();
+        }
+        unsigned bit_shift = static_cast<unsigned>(bits % 32);
+        Limbs result(a.size() - limb_shift);
+        for (size_t i = 0; i < result.size(); ++i) {
+            uint64_t low = a[i + limb_shift];
+            uint64_t high = (i + limb_shift + 1 < a.size()) ? a[i + limb_shift + 1] : 0;
+            result[i] = static_cast<uint32_t>(((high << 32) | low) >> bit_shift);
+        }
+        trim(result);
+        return result;
+    }
+};
+
+/*
+* =======================================================================================
+* Chudnovsky Engine(Binary Splitting)
+* =======================================================================================
+*
+* The Chudnovsky series
+*     1/pi = 12 * sum_k (-1)^k (6k)! (13591409 + 545140134k) / ((3k)! (k!)^3 640320^(3k+3/2))
+* adds about 14.18 decimal digits per term. Binary splitting evaluates the first
+* `terms` terms exactly as three integers P(0,N), Q(0,N), T(0,N):
+* - Leaf a(a > 0): P = (6a-5)(2a-1)(6a-1), Q = a^3 * 640320^3 / 24,
+*   T = (-1)^a * P * (13591409 + 545140134a). Leaf 0 is P = Q = 1, T = 13591409.
+* - Merge [a,m) and [m,b): P = P1*P2, Q = Q1*Q2, T = T1*Q2 + P1*T2.
+*   P of the rightmost range is never used, so it is not formed.
+* Then pi = 426880 * sqrt(10005) * Q / T. The whole expression is evaluated as a single
+* integer scaled by 10^(n + CHUDNOVSKY_GUARD_DIGITS) and the guard digits are dropped.
+* Q and T are truncated to the working precision before the final division.
+* The total cost is dominated by the big multiplications near the top of the recursion
+* tree, i.e. O(M(n) log n) instead of the spigot's O(n^2).
+* Subtrees of at most `CHUDNOVSKY_ARENA_TERMS` terms run inside a `LimbArenaScope`: all
+* their temporaries come from the thread's limb arena, only the three results are
+* copied to the heap, and the arena is rewound for the next subtree.
+* Threads(`-t`, the multiply thread count): a `TaskScheduler` runs the left half of
+* every range longer than `CHUDNOVSKY_PARALLEL_TERMS` terms as a stealable task, down to
+* `CHUDNOVSKY_EXTRA_FORK_DEPTH` levels below log2(threads), which leaves several tasks
+* per thread for load balancing(the right halves carry bigger numbers). Merges with
+* operands of at least `CHUDNOVSKY_PARALLEL_MERGE_LIMBS` limbs run their three or four
+* products as tasks, and the NTT loops inside them use the same workers.
+*
+* Incremental extension: P, Q and T of [0, N) are exact integers, so a `ChudnovskySeries`
+* that keeps them(P included) can be extended to [0, N') by splitting only [N, N') and
+* merging it on the right. The decimal digits are then re-derived from the extended
+* Q and T, which costs one division and one square root at the new precision, but the
+* binary splitting of the shared prefix is never repeated. `calculatePiDigitsChudnovsky`
+* with a series file loads it, extends it if the request needs more terms and saves it
+* back. The spigot cannot be extended the same way: its state length is fixed by n.
+*/
+const int CHUDNOVSKY_GUARD_DIGITS = 10;
+const long long CHUDNOVSKY_ARENA_TERMS = 1024;
+const long long CHUDNOVSKY_PARALLEL_TERMS = 4 * CHUDNOVSKY_ARENA_TERMS;
+const int CHUDNOVSKY_EXTRA_FORK_DEPTH = 3;
+const size_t CHUDNOVSKY_PARALLEL_MERGE_LIMBS = 4096;
+const double CHUDNOVSKY_DIGITS_PER_TERM = 14.181647462725477;
+
+// Threads of the Chudnovsky engine: the scheduler the caller already works for(the
+// engine object's), otherwise the big-integer multiply thread count.
+std::unique_ptr<TaskScheduler> makeChudnovskyScheduler() {
+    unsigned threads = multiplyThreadsSetting().load();
+    bool own = TaskScheduler::current() == nullptr && threads > 1;
+    return std::unique_ptr<TaskScheduler>(own ? new TaskScheduler(threads) : nullptr);
+}
+
+int chudnovskyForkDepth(unsigned threads) {
+    return floorLog2(threads) + 1 + CHUDNOVSKY_EXTRA_FORK_DEPTH;
+}
+
+// P, Q, T of [a,b) from those of [a,m) and [m,b). The outputs may alias the inputs.
+void chudnovskyMerge(const BigInt& P1, const BigInt& Q1, const BigInt& T1,
+                     const BigInt& P2, const BigInt& Q2, const BigInt& T2, bool need_p,
+                     BigInt& P, BigInt& Q, BigInt& T) {
+    BigInt left, right, product_q, product_p;
+    TaskScheduler* scheduler = TaskScheduler::current();
+    if (scheduler && !LimbArena::active() && Q2.bitLength() >= 32 * CHUDNOVSKY_PARALLEL_MERGE_LIMBS) {
+        TaskGroup group(*scheduler);
+        group.spawn([&]() {
+            LimbArenaSuspend heap;
+            left = T1 * Q2;
+        });
+        group.spawn([&]() {
+            LimbArenaSuspend heap;
+            product_q = Q1 * Q2;
+        });
+        if (need_p) {
+            group.spawn([&]() {
+                LimbArenaSuspend heap;
+                product_p = P1 * P2;
+            });
+        }
+        right = P1 * T2;
+        group.wait();
+    }
+    else {
+        left = T1 * Q2;
+        right = P1 * T2;
+        product_q = Q1 * Q2;
+        if (need_p) {
+            product_p = P1 * P2;
+        }
+    }
+    T = std::move(left) + right;
+    Q = std::move(product_q);
+    P = std::move(product_p);
+}
+
+void chudnovskySplit(long long a, long long b, bool need_p, BigInt& P, BigInt& Q, BigInt& T, int depth = 0) {
+    if (b - a <= CHUDNOVSKY_ARENA_TERMS && !LimbArena::active()) {
+        LimbArenaScope scope;
+        BigInt p, q, t;
+        chudnovskySplit(a, b, need_p, p, q, t);
+        LimbArenaSuspend heap;
+        P = p;
+        Q = q;
+        T = t;
+        return;
+    }
+    if (b - a == 1) {
+        if (a == 0) {
+            P = 1;
+            Q = 1;
+        }
+        else {
+            P = BigInt(6 * a - 5) * BigInt(2 * a - 1) * BigInt(6 * a - 1);
+            Q = BigInt(a) * BigInt(a) * BigInt(a) * BigInt(10939058860032000LL);
+        }
+        T = P * BigInt(13591409LL + 545140134LL * a);
+        if (a % 2 == 1) {
+            T = -T;
+        }
+        return;
+    }
+
+    long long m = a + (b - a) / 2;
+    BigInt P1, Q1, T1, P2, Q2, T2;
+    TaskScheduler* scheduler = TaskScheduler::current();
+    if (scheduler && b - a > CHUDNOVSKY_PARALLEL_TERMS && depth < chudnovskyForkDepth(scheduler->threadCount())) {
+        TaskGroup group(*scheduler);
+        group.spawn([&]() {
+            LimbArenaSuspend heap;  // the results outlive any scope of the thread that runs this
+            chudnovskySplit(a, m, true, P1, Q1, T1, depth + 1);
+        });
+        chudnovskySplit(m, b, need_p, P2, Q2, T2, depth + 1);
+        group.wait();
+    }
+    else {
+        chudnovskySplit(a, m, true, P1, Q1, T1, depth + 1);
+        chudnovskySplit(m, b, need_p, P2, Q2, T2, depth + 1);
+    }
+    chudnovskyMerge(P1, Q1, T1, P2, Q2, T2, need_p, P, Q, T);
+}
+
+long long chudnovskyTerms(long long n) {
+    return static_cast<long long>(n / CHUDNOVSKY_DIGITS_PER_TERM) + 2;
+}
+
+// "3.xxxx" with n decimals from Q(0,N) and T(0,N); any N >= chudnovskyTerms(n) works.
+std::string chudnovskyDigits(long long n, BigInt Q, BigInt T) {
+    unsigned long long scaled_digits = static_cast<unsigned long long>(n) + CHUDNOVSKY_GUARD_DIGITS;
+    BigInt sqrt_c = BigInt::isqrt(BigInt(10005) * BigInt::pow(10, 2 * scaled_digits));
+
+    // Q and T carry far more bits than the quotient needs; only their ratio matters,
+    // so drop the excess low bits from both before the division.
+    size_t needed_bits = static_cast<size_t>(scaled_digits * 3.3219280948873623) + 64;
+    size_t t_bits = T.bitLength();
+    if (t_bits > needed_bits) {
+        Q >>= t_bits - needed_bits;
+        T >>= t_bits - needed_bits;
+    }
+    BigInt pi_scaled = BigInt::divide(BigInt(426880) * sqrt_c * Q, T);
+
+    // pi_scaled has n + 1 + CHUDNOVSKY_GUARD_DIGITS digits; the guard digits go first, and
+    // the rest is written one character to the right so that "3" can move in front of '.'.
+    for (int guard = 0; guard < CHUDNOVSKY_GUARD_DIGITS; ++guard) {
+        pi_scaled.divmodSmall(10);
+    }
+    std::string digits(2 + static_cast<size_t>(n), '0');
+    pi_scaled.writeDecimalDigits(&digits[1], 1 + static_cast<size_t>(n));
+    digits[0] = digits[1];
+    digits[1] = '.';
+    return digits;
+}
+
+std::string calculatePiDigitsChudnovsky(long long n) {
+    if (n <= 0) {
+        return "3.";
+    }
+    std::unique_ptr<TaskScheduler> scheduler = makeChudnovskyScheduler();
+    BigInt P, Q, T;
+    chudnovskySplit(0, chudnovskyTerms(n), false, P, Q, T);
+    return chudnovskyDigits(n, std::move(Q), std::move(T));
+}
+
+struct ChudnovskySeries {
+    long long terms;  // the series covers terms [0, terms)
+    BigInt P, Q, T;
+
+    ChudnovskySeries() : terms(0) {}
+};
+
+// Defined with the split workers(Distributed Binary Splitting).
+void chudnovskySplitDistributed(long long a, long long b, bool need_p, const std::vector<std::string>& nodes,
+                                BigInt& P, BigInt& Q, BigInt& T);
+
+// With `nodes`, the new terms are split by those workers instead of locally.
+void extendChudnovskySeries(ChudnovskySeries& series, long long terms, const std::vector<std::string>& nodes) {
+    if (terms <= series.terms) {
+        return;
+    }
+    BigInt P, Q, T;
+    if (nodes.empty()) {
+        chudnovskySplit(series.terms, terms, true, P, Q, T);
+    }
+    else {
+        chudnovskySplitDistributed(series.terms, terms, true, nodes, P, Q, T);
+    }
+    if (series.terms == 0) {
+        series.P = P;
+        series.Q = Q;
+        series.T = T;
+    }
+    else {
+        chudnovskyMerge(series.P, series.Q, series.T, P, Q, T, true, series.P, series.Q, series.T);
+    }
+    series.terms = terms;
+}
+
+std::string calculatePiDigitsChudnovsky(long long n, ChudnovskySeries& series,
+                                        const std::vector<std::string>& nodes = std::vector<std::string>()) {
+    if (n <= 0) {
+        return "3.";
+    }
+    std::unique_ptr<TaskScheduler> scheduler = makeChudnovskyScheduler();
+    extendChudnovskySeries(series, chudnovskyTerms(n), nodes);
+    return chudnovskyDigits(n, series.Q, series.T);
+}
+
+const char CHUDNOVSKY_SERIES_MAGIC[8] = { 'P', 'I', 'T', 'I', 'M', 'E', 'S', '1' };
+
+// Returns false when `path` does not exist; a file that exists but cannot be read throws.
+bool loadChudnovskySeries(const std::string& path, ChudnovskySeries& series) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    char magic[8];
+    int64_t terms = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&terms), sizeof(terms));
+    if (!in || std::memcmp(magic, CHUDNOVSKY_SERIES_MAGIC, sizeof(magic)) != 0 || terms < 0) {
+        throw std::runtime_error("'" + path + "' is not a Chudnovsky series file");
+    }
+    series.P = BigInt::readBinary(in);
+    series.Q = BigInt::readBinary(in);
+    series.T = BigInt::readBinary(in);
+    series.terms = terms;
+    return true;
+}
+
+// Writes to "<path>.tmp" first and renames it, so an interrupted save keeps the old file.
+void saveChudnovskySeries(const std::string& path, const ChudnovskySeries& series) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        int64_t terms = series.terms;
+        out.write(CHUDNOVSKY_SERIES_MAGIC, sizeof(CHUDNOVSKY_SERIES_MAGIC));
+        out.write(reinterpret_cast<const char*>(&terms), sizeof(terms));
+        series.P.writeBinary(out);
+        series.Q.writeBinary(out);
+        series.T.writeBinary(out);
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("cannot write '" + temporary + "'");
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("cannot replace '" + path + "': " + std::strerror(errno));
+    }
+}
+
+std::string calculatePiDigitsChudnovsky(long long n, const std::string& series_path) {
+    ChudnovskySeries series;
+    loadChudnovskySeries(series_path, series);
+    long long stored_terms = series.terms;
+    std::string digits = calculatePiDigitsChudnovsky(n, series);
+    if (series.terms != stored_terms) {
+        saveChudnovskySeries(series_path, series);
+    }
+    return digits;
+}
+
+/*
+* =======================================================================================
+* Machin-Like Arctangent Engines(Fixed Point, Base 10^9)
+* =======================================================================================
+*
+* pi as a short sum of arctangents of reciprocals of integers:
+*     Machin:  pi = 16 atan(1/5) - 4 atan(1/239)
+*     Takano:  pi = 48 atan(1/49) + 128 atan(1/57) - 20 atan(1/239) + 48 atan(1/110443)
+* with atan(1/x) = sum_k (-1)^k / ((2k+1) x^(2k+1)). Each series is evaluated on its own
+* fixed-point array of base 10^9 limbs, big-endian, with limb 0 holding the integer
+* part. The arithmetic is single-word only:
+* - `power` starts at |c|/x(c the coefficient) and is divided by x^2 after every term.
+*   A running remainder below x^2 times 10^9 stays within 64 bits for every x below
+*   135818, so the step is a single division per limb even for x = 110443.
+* - One pass covers `MACHIN_TERMS_PER_PASS` consecutive terms and walks `power` from
+*   its first nonzero limb down. For each limb and term it forms the term limb
+*   power/(2k+1) and the next power limb power/x^2, and adds the term limb to the int64
+*   sum(or subtracts it) without propagating the carry. The remainder chains of the
+*   terms are independent, so their multiplier latencies overlap.
+*   Carries are resolved once at the end; a limb of the sum collects under 10^9 per
+*   term, which leaves room for about 10^9 terms.
+* - Both divisors are fixed for the whole pass, so the divisions go through a reciprocal
+*   multiplier(`reciprocalMagic`, the scheme of the reciprocal spigot kernel) and not
+*   the hardware divider.
+* - The leading limbs of `power` that have become zero are skipped. The pass shrinks as
+*   the series converges, for about n^2 / (2 * 81 * log10(x^2)) limb steps per series
+*   in place of the spigot's n * len element updates.
+* The series are independent and run concurrently(`threads`, one series per thread).
+* They are combined with their signs at the end. Each division truncates by less than
+* one unit of the last limb, and `power` shrinks by x^2 per term, so a series loses at
+* most three units per term. `MACHIN_GUARD_LIMBS`(18 digits) absorb that for any
+* feasible digit count.
+* Machin's formula is the fast one. Takano's shares no series with Chudnovsky or the
+* spigot and only atan(1/239) with Machin, so the two make a cheap independent cross-check.
+*/
+const size_t MACHIN_GUARD_LIMBS = 2;
+const uint32_t MACHIN_LIMB_BASE = 1000000000u;
+const uint32_t MACHIN_MAX_X = 135817;
+const size_t MACHIN_TERMS_PER_PASS = 4;
+
+struct MachinTerm {
+    int coefficient;
+    uint32_t x;
+};
+
+std::vector<MachinTerm> machinTerms(MachinFormula formula) {
+    if (formula == MachinFormula::Takano) {
+        MachinTerm terms[] = { { 48, 49 }, { 128, 57 }, { -20, 239 }, { 48, 110443 } };
+        return std::vector<MachinTerm>(terms, terms + 4);
+    }
+    MachinTerm terms[] = { { 16, 5 }, { -4, 239 } };
+    return std::vector<MachinTerm>(terms, terms + 2);
+}
+
+// |coefficient| * atan(1/x) as `limbs` fixed-point limbs with unresolved carries.
+std::vector<int64_t> machinArctangent(int coefficient, uint32_t x, size_t limbs) {
+    if (x < 2 || x > MACHIN_MAX_X) {
+        throw std::invalid_argument("machinArctangent: x out of range");
+    }
+    std::vector<uint32_t> power(limbs, 0);
+    std::vector<int64_t> sum(limbs, 0);
+
+    // power = |coefficient| / x
+    uint64_t remainder = 0;
+    for (size_t i = 0; i < limbs; ++i) {
+        uint64_t current = remainder * MACHIN_LIMB_BASE + (i == 0 ? static_cast<uint64_t>(std::abs(coefficient)) : 0);
+        power[i] = static_cast<uint32_t>(current / x);
+        remainder = current % x;
+    }
+
+    uint64_t x_squared = static_cast<uint64_t>(x) * x;
+    uint64_t power_magic = reciprocalMagic(x_squared);
+    int power_shift = floorLog2(x_squared);
+    const size_t group = MACHIN_TERMS_PER_PASS;
+    size_t first = 0;
+    for (uint64_t k = 0;; k += group) {
+        while (first < limbs && power[first] == 0) {
+            ++first;
+        }
+        if (first == limbs) {
+            break;
+        }
+        uint64_t odd[MACHIN_TERMS_PER_PASS], odd_magic[MACHIN_TERMS_PER_PASS];
+        int odd_shift[MACHIN_TERMS_PER_PASS];
+        uint64_t term_remainder[MACHIN_TERMS_PER_PASS], power_remainder[MACHIN_TERMS_PER_PASS];
+        for (size_t j = 0; j < group; ++j) {
+            odd[j] = 2 * (k + j) + 1;
+            if (odd[j] > 0xFFFFFFFFull) {
+                throw std::length_error("digit count too large for the Machin engine");
+            }
+            odd_magic[j] = (odd[j] > 1) ? reciprocalMagic(odd[j]) : 0;
+            odd_shift[j] = floorLog2(odd[j]);
+            term_remainder[j] = 0;
+            power_remainder[j] = 0;
+        }
+        // Stream j carries power_{k+j}: the limb read from `power` for j = 0, else the
+        // quotient stream j-1 just produced. Every stream has its own remainder chain.
+        for (size_t i = first; i < limbs; ++i) {
+            uint64_t limb = power[i];
+            int64_t delta = 0;
+            for (size_t j = 0; j < group; ++j) {
+                uint64_t term_current = term_remainder[j] * MACHIN_LIMB_BASE + limb;
+                uint64_t term = (odd[j] > 1) ? divideByMagic(term_current, odd_magic[j], odd_shift[j]) : term_current;
+                term_remainder[j] = term_current - term * odd[j];
+                delta += ((k + j) % 2 == 1) ? -static_cast<int64_t>(term) : static_cast<int64_t>(term);
+
+                uint64_t power_current = power_remainder[j] * MACHIN_LIMB_BASE + limb;
+                limb = divideByMagic(power_current, power_magic, power_shift);
+                power_remainder[j] = power_current - limb * x_squared;
+            }
+            sum[i] += delta;
+            power[i] = static_cast<uint32_t>(limb);
+        }
+    }
+    return sum;
+}
+
+std::string calculatePiDigitsMachin(long long n, MachinFormula formula, unsigned threads) {
+    if (n <= 0) {
+        return "3.";
+    }
+    size_t limbs = 1 + static_cast<size_t>((n + 8) / 9) + MACHIN_GUARD_LIMBS;
+    std::vector<MachinTerm> terms = machinTerms(formula);
+    std::vector<std::vector<int64_t> > series(terms.size());
+    parallelFor(terms.size(), threads, [&](size_t index) {
+        series[index] = machinArctangent(terms[index].coefficient, terms[index].x, limbs);
+    });
+
+    std::vector<int64_t> pi(limbs, 0);
+    for (size_t index = 0; index < terms.size(); ++index) {
+        bool negative = terms[index].coefficient < 0;
+        for (size_t i = 0; i < limbs; ++i) {
+            pi[i] += negative ? -series[index][i] : series[index][i];
+        }
+    }
+    // Resolve the carries(floor division, the limbs may be negative).
+    int64_t carry = 0;
+    for (size_t i = limbs; i-- > 1;) {
+        int64_t value = pi[i] + carry;
+        carry = value / MACHIN_LIMB_BASE;
+        value -= carry * MACHIN_LIMB_BASE;
+        if (value < 0) {
+            value += MACHIN_LIMB_BASE;
+            carry -= 1;
+        }
+        pi[i] = value;
+    }
+    pi[0] += carry;
+
+    std::string digits = std::to_string(pi[0]) + ".";
+    digits.reserve(2 + (limbs - 1) * 9);
+    for (size_t i = 1; i < limbs; ++i) {
+        char buffer[9];
+        uint32_t limb = static_cast<uint32_t>(pi[i]);
+        for (int k = 8; k >= 0; --k) {
+            buffer[k] = static_cast<char>('0' + limb % 10);
+            limb /= 10;
+        }
+        digits.append(buffer, 9);
+    }
+    digits.resize(2 + static_cast<size_t>(n));
+    return digits;
+}
+
+/*
+* =======================================================================================
+* BBP Digit Extraction(Hexadecimal and Binary)
+* =======================================================================================
+*
+* The Bailey-Borwein-Plouffe formula
+*     pi = sum_k 16^-k (4/(8k+1) - 2/(8k+4) - 1/(8k+5) - 1/(8k+6))
+* gives the hexadecimal digits of pi from any position d without the ones before it:
+*     frac(16^d pi) = frac(4 S(1) - 2 S(4) - S(5) - S(6)),
+*     S(j) = sum_{k<=d} (16^(d-k) mod (8k+j)) / (8k+j) + sum_{k>d} 16^(d-k) / (8k+j).
+* - The left sum uses modular exponentiation(`powMod64`), so every term stays small.
+* - Fractions are accumulated in 128-bit fixed point(`BbpFraction`, two 64-bit words);
+*   unsigned wrap-around is exactly "mod 1". Each term is truncated, so after the
+*   roughly 4(d+33) terms the error is below 8(d+33) units of 2^-128.
+* - `bbpHexChunk(d)` returns the top 64 bits, i.e. the 16 hex digits starting at
+*   position d(position 0 is the "2" of 3.243F6A88...). If the discarded low word is
+*   within the error bound of a digit boundary the digits are ambiguous and it throws;
+*   at 64 guard bits this practically never happens.
+* `calculatePiHexDigits` splits the requested range into 16-digit chunks and runs them
+* on a small thread pool(`parallelFor`); `calculatePiBinaryDigits` expands hex digits
+* into bits. Offsets are limited to 2^56 so every modulus stays below 2^63.
+*/
+const size_t BBP_CHUNK_DIGITS = 16;
+
+inline uint64_t mulMod64(uint64_t a, uint64_t b, uint64_t m) {
+    if (m <= 0xFFFFFFFFULL) {
+        return a * b % m;
+    }
+    uint64_t remainder = 0;
+    divide128(mulHigh64(a, b), a * b, m, remainder);
+    return remainder;
+}
+
+// base^exponent mod m, for m >= 1.
+uint64_t powMod64(uint64_t base, uint64_t exponent, uint64_t m) {
+    uint64_t result = 1 % m;
+    base %= m;
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = mulMod64(result, base, m);
+        }
+        exponent >>= 1;
+        if (exponent > 0) {
+            base = mulMod64(base, base, m);
+        }
+    }
+    return result;
+}
+
+struct BbpFraction {
+    uint64_t high;
+    uint64_t low;
+
+    BbpFraction() : high(0), low(0) {}
+
+    // floor(r * 2^128 / m) for r < m.
+    static BbpFraction ratio(uint64_t r, uint64_t m) {
+        BbpFraction result;
+        uint64_t remainder = 0;
+        result.high = divide128(r, 0, m, remainder);
+        result.low = divide128(remainder, 0, m, remainder);
+        return result;
+    }
+
+    BbpFraction& operator+=(const BbpFraction& other) {
+        low += other.low;
+        high += other.high + (low < other.low ? 1 : 0);
+        return *this;
+    }
+
+    BbpFraction& operator-=(const BbpFraction& other) {
+        uint64_t borrow = (low < other.low) ? 1 : 0;
+        low -= other.low;
+        high -= other.high + borrow;
+        return *this;
+    }
+
+    BbpFraction shiftedRight(unsigned bits) const {
+        BbpFraction result;
+        if (bits >= 128) {
+            return result;
+        }
+        if (bits >= 64) {
+            result.low = high >> (bits - 64);
+            return result;
+        }
+        result.high = high >> bits;
+        result.low = (bits == 0) ? low : ((low >> bits) | (high << (64 - bits)));
+        return result;
+    }
+};
+
+// frac(S(j)) at position d in 128-bit fixed point.
+BbpFraction bbpSeries(uint64_t d, uint64_t j) {
+    BbpFraction sum;
+    for (uint64_t k = 0; k <= d; ++k) {
+        uint64_t m = 8 * k + j;
+        sum += BbpFraction::ratio(powMod64(16, d - k, m), m);
+    }
+    // 16^-(k-d) / m for k > d: 2^128/m shifted right by 4(k-d) bits, until it vanishes.
+    for (uint64_t k = d + 1; 4 * (k - d) < 128; ++k) {
+        uint64_t m = 8 * k + j;
+        BbpFraction unit = BbpFraction::ratio(1, m);
+        if (unit.high == 0 && unit.low == 0) {
+            break;
+        }
+        sum += unit.shiftedRight(static_cast<unsigned>(4 * (k - d)));
+    }
+    return sum;
+}
+
+// The 16 hex digits of pi starting at hex position d, most significant first.
+uint64_t bbpHexChunk(uint64_t d) {
+    BbpFraction s1 = bbpSeries(d, 1), s4 = bbpSeries(d, 4), s5 = bbpSeries(d, 5), s6 = bbpSeries(d, 6);
+    BbpFraction x;
+    for (int k = 0; k < 4; ++k) {
+        x += s1;
+    }
+    x -= s4;
+    x -= s4;
+    x -= s5;
+    x -= s6;
+
+    uint64_t error_bound = 8 * (d + 40);
+    if (x.low < error_bound || x.low > ~error_bound) {
+        throw std::runtime_error("BBP digits at position " + std::to_string(d) +
+                                 " are too close to a digit boundary to resolve");
+    }
+    return x.high;
+}
+
+std::string calculatePiHexDigits(unsigned long long offset, size_t count, unsigned threads) {
+    if (offset > BBP_MAX_OFFSET || count > BBP_MAX_OFFSET - offset) {
+        throw std::length_error("BBP offset too large");
+    }
+    static const char hex[] = "0123456789ABCDEF";
+    std::string digits(count, '0');
+    size_t chunks = (count + BBP_CHUNK_DIGITS - 1) / BBP_CHUNK_DIGITS;
+    parallelFor(chunks, threads, [&](size_t chunk) {
+        uint64_t value = bbpHexChunk(offset + chunk * BBP_CHUNK_DIGITS);
+        size_t first = chunk * BBP_CHUNK_DIGITS;
+        size_t last = std::min(count, first + BBP_CHUNK_DIGITS);
+        for (size_t i = first; i < last; ++i) {
+            digits[i] = hex[(value >> (60 - 4 * (i - first))) & 0xF];
+        }
+    });
+    return digits;
+}
+
+// Binary digits of pi starting at bit position `offset` after the point.
+std::string calculatePiBinaryDigits(unsigned long long offset, size_t count, unsigned threads) {
+    size_t skip = static_cast<size_t>(offset % 4);
+    std::string hex = calculatePiHexDigits(offset / 4, (skip + count + 3) / 4, threads);
+    std::string bits;
+    bits.reserve(count);
+    for (size_t i = skip; i < skip + count; ++i) {
+        char digit = hex[i / 4];
+        int value = (digit <= '9') ? digit - '0' : digit - 'A' + 10;
+        bits.push_back(static_cast<char>('0' + ((value >> (3 - i % 4)) & 1)));
+    }
+    return bits;
+}
+
+bool parsePiEngine(const std::string& name, PiEngine& engine) {
+    if (name == "spigot") {
+        engine = PiEngine::Spigot;
+        return true;
+    }
+    if (name == "spigot4") {
+        engine = PiEngine::SpigotLimb4;
+        return true;
+    }
+    if (name == "spigot9") {
+        engine = PiEngine::SpigotLimb9;
+        return true;
+    }
+    if (name == "chudnovsky") {
+        engine = PiEngine::Chudnovsky;
+        return true;
+    }
+    if (name == "machin") {
+        engine = PiEngine::Machin;
+        return true;
+    }
+    if (name == "takano") {
+        engine = PiEngine::Takano;
+        return true;
+    }
+    return false;
+}
+
+const char* piEngineName(PiEngine engine) {
+    switch (engine) {
+    case PiEngine::SpigotLimb4:
+        return "spigot4";
+    case PiEngine::SpigotLimb9:
+        return "spigot9";
+    case PiEngine::Chudnovsky:
+        return "chudnovsky";
+    case PiEngine::Machin:
+        return "machin";
+    case PiEngine::Takano:
+        return "takano";
+    case PiEngine::Spigot:
+    default:
+        return "spigot";
+    }
+}
+
+bool isSpigotEngine(PiEngine engine) {
+    return engine == PiEngine::Spigot || engine == PiEngine::SpigotLimb4 || engine == PiEngine::SpigotLimb9;
+}
+
+std::string calculatePiDigitsString(long long n, PiEngine engine, const SpigotOptions& spigot_options) {
+    SpigotOptions options = spigot_options;
+    switch (engine) {
+    case PiEngine::SpigotLimb4:
+        options.limb_digits = 4;
+        return calculatePiDigitsSpigot(n, options);
+    case PiEngine::SpigotLimb9:
+        options.limb_digits = 9;
+        return calculatePiDigitsSpigot(n, options);
+    case PiEngine::Chudnovsky:
+        return calculatePiDigitsChudnovsky(n);
+    case PiEngine::Machin:
+        return calculatePiDigitsMachin(n, MachinFormula::Machin, options.threads);
+    case PiEngine::Takano:
+        return calculatePiDigitsMachin(n, MachinFormula::Takano, options.threads);
+    case PiEngine::Spigot:
+    default:
+        if (options.division == SpigotDivision::Reciprocal || options.simd || !options.checkpoint_path.empty() ||
+            options.tile_elements != 0 || options.profile != nullptr || options.progress != nullptr ||
+            options.shrink_window) {
+            options.limb_digits = 1;
+            return calculatePiDigitsSpigot(n, options);
+        }
+        return calculatePiDigitsString(n);
+    }
+}
+
+std::string calculatePiDigitsString(long long n, PiEngine engine) {
+    return calculatePiDigitsString(n, engine, SpigotOptions());
+}
+
+/*
+* Streaming: the spigot engines hand out digits as soon as the predigit/nines logic
+* confirms them(the plain "spigot" engine streams through the k = 1 limb kernel).
+* Chudnovsky and the arctangent engines only know their digits at the very end, so they
+* deliver them in one chunk.
+*/
+void streamPiDigits(long long n, PiEngine engine, const SpigotOptions& spigot_options, const DigitSink& sink) {
+    SpigotOptions options = spigot_options;
+    switch (engine) {
+    case PiEngine::Chudnovsky:
+    case PiEngine::Machin:
+    case PiEngine::Takano: {
+        std::string digits = calculatePiDigitsString(n, engine, options);
+        sink(digits.data(), digits.size());
+        return;
+    }
+    case PiEngine::SpigotLimb4:
+        options.limb_digits = 4;
+        break;
+    case PiEngine::SpigotLimb9:
+        options.limb_digits = 9;
+        break;
+    case PiEngine::Spigot:
+    default:
+        options.limb_digits = 1;
+        break;
+    }
+    streamPiDigitsSpigot(n, options, sink);
+}
+
+bool parseSpigotDivision(const std::string& name, SpigotDivision& division) {
+    if (name == "hardware") {
+        division = SpigotDivision::Hardware;
+        return true;
+    }
+    if (name == "reciprocal") {
+        division = SpigotDivision::Reciprocal;
+        return true;
+    }
+    return false;
+}
+
+/*
+* Engine Interface:
+* -----------------
+* The `DigitEngine` implementations behind `makeDigitEngine` and `makeBbpEngine`.
+* `DigitEngine::stream` checks the request against `supports` and the memory limit and
+* then runs it. The estimates cover the dominant allocations of a request and the
+* result string, not the whole process:
+* - Spigot engines: the state array at the width the run will pick, plus the reciprocal
+*   table with that kernel; out of core, the memory budget. The digits are streamed as
+*   they are confirmed.
+* - Machin engines: the int64 sum of every series, and the power and sum arrays of each
+*   series running at once.
+* - Chudnovsky: `CHUDNOVSKY_BYTES_PER_DIGIT` per decimal; the measured peak is about 32
+*   bytes in the final multiplications and the division. The engine keeps its
+*   `ChudnovskySeries`(P included) between requests, so a longer request only splits
+*   the new terms and a shorter one costs a division and a square root. With `threads`
+*   > 1 every request runs on a `TaskScheduler` of that many workers. With `nodes` the
+*   new terms are split by those split workers(see Distributed Binary Splitting) and
+*   merged here; the estimate stays the same, it is the coordinator's.
+* - BBP: the requested digits; each chunk of 16 hex digits is computed independently.
+* The estimates are formed with `saturatingAdd` and `saturatingMultiply`, so a count
+* near the cap of `stream`(LLONG_MAX / 4) yields the largest value instead of a
+* wrapped one and is still refused by any limit.
+* Short decimal requests are dominated by setup, not by the sweep: even the spigot's
+* 3.3 million divisions for 1000 digits take milliseconds. So with `use_table`,
+* `stream` answers any decimal request of up to `PI_TABLE_DIGITS` decimals from
+* `PI_TABLE`, a compile-time constant, without allocating or starting an engine. Every
+* engine truncates rather than rounds, so a prefix of the table is the exact output of
+* every engine at that length. Turn it off to exercise or time the engines themselves.
+*/
+const unsigned long long CHUDNOVSKY_BYTES_PER_DIGIT = 40;
+
+unsigned long long saturatingAdd(unsigned long long a, unsigned long long b) {
+    return (a > std::numeric_limits<unsigned long long>::max() - b) ? std::numeric_limits<unsigned long long>::max()
+                                                                     : a + b;
+}
+
+unsigned long long saturatingMultiply(unsigned long long a, unsigned long long b) {
+    return (b != 0 && a > std::numeric_limits<unsigned long long>::max() / b)
+        ? std::numeric_limits<unsigned long long>::max() : a * b;
+}
+
+constexpr char PI_TABLE[] =
+    "3."
+    "1415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679"
+    "8214808651328230664709384460955058223172535940812848111745028410270193852110555964462294895493038196"
+    "4428810975665933446128475648233786783165271201909145648566923460348610454326648213393607260249141273"
+    "7245870066063155881748815209209628292540917153643678925903600113305305488204665213841469519415116094"
+    "3305727036575959195309218611738193261179310511854807446237996274956735188575272489122793818301194912"
+    "9833673362440656643086021394946395224737190702179860943702770539217176293176752384674818467669405132"
+    "0005681271452635608277857713427577896091736371787214684409012249534301465495853710507922796892589235"
+    "4201995611212902196086403441815981362977477130996051870721134999999837297804995105973173281609631859"
+    "5024459455346908302642522308253344685035261931188171010003137838752886587533208381420617177669147303"
+    "5982534904287554687311595628638823537875937519577818577805321712268066130019278766111959092164201989";
+
+static_assert(sizeof(PI_TABLE) == PI_TABLE_DIGITS + 3, "PI_TABLE holds \"3.\" and PI_TABLE_DIGITS decimals");
+
+void DigitEngine::stream(const DigitRequest& request, const DigitSink& sink) {
+    if (!supports(request.radix)) {
+        const char* radix = (request.radix == DigitRadix::Decimal) ? "decimal"
+                          : (request.radix == DigitRadix::Hexadecimal) ? "hexadecimal" : "binary";
+        throw std::invalid_argument(std::string("the ") + name() + " engine does not produce " + radix + " digits");
+    }
+    if (request.radix == DigitRadix::Decimal && request.offset != 0) {
+        throw std::invalid_argument("decimal digits start at the point(offset 0)");
+    }
+    if (request.count > static_cast<unsigned long long>(std::numeric_limits<long long>::max() / 4)) {
+        throw std::invalid_argument("digit count out of range");
+    }
+    if (settings.use_table && request.radix == DigitRadix::Decimal && request.count <= PI_TABLE_DIGITS) {
+        sink(PI_TABLE, static_cast<size_t>(request.count) + 2);
+        return;
+    }
+    unsigned long long estimate = memoryEstimate(request);
+    if (settings.memory_limit != 0 && estimate > settings.memory_limit) {
+        throw std::length_error(std::string("the ") + name() + " engine needs about " + std::to_string(estimate) +
+                                " bytes for this request, more than the limit of " +
+                                std::to_string(settings.memory_limit));
+    }
+    run(request, sink);
+}
+
+std::string DigitEngine::digits(const DigitRequest& request) {
+    std::string result;
+    stream(request, [&result](const char* digits, size_t count) {
+        result.append(digits, count);
+    });
+    return result;
+}
+
+class SpigotDigitEngine : public DigitEngine {
+public:
+    SpigotDigitEngine(PiEngine engine, const EngineOptions& options) : DigitEngine(options), engine(engine) {
+        settings.spigot.threads = std::max(1u, settings.threads);
+        settings.spigot.limb_digits = (engine == PiEngine::SpigotLimb9) ? 9 : (engine == PiEngine::SpigotLimb4) ? 4 : 1;
+    }
+
+    const char* name() const override { return piEngineName(engine); }
+
+    bool supports(DigitRadix radix) const override { return radix == DigitRadix::Decimal; }
+
+    unsigned long long memoryEstimate(const DigitRequest& request) const override {
+        if (request.count == 0) {
+            return 2;
+        }
+        SpigotRunShape shape(static_cast<long long>(request.count), settings.spigot.limb_digits);
+        unsigned long long budget = settings.spigot.memory_budget;
+        if (budget != 0 && saturatingMultiply(shape.stateBytes(), shape.len) > budget) {
+            // Out of core: the three segment buffers.
+            return saturatingAdd(std::max<unsigned long long>(budget, 3 * SPIGOT_SPILL_MIN_SEGMENT * shape.stateBytes()),
+                                 request.count + 2);
+        }
+        unsigned long long per_element = shape.stateBytes();
+        if (settings.spigot.division == SpigotDivision::Reciprocal) {
+            per_element += sizeof(uint64_t);
+        }
+        return saturatingAdd(saturatingMultiply(per_element, shape.len), request.count + 2);
+    }
+
+protected:
+    void run(const DigitRequest& request, const DigitSink& sink) override {
+        streamPiDigitsSpigot(static_cast<long long>(request.count), settings.spigot, sink);
+    }
+
+private:
+    PiEngine engine;
+};
+
+class MachinDigitEngine : public DigitEngine {
+public:
+    MachinDigitEngine(MachinFormula formula, const EngineOptions& options) : DigitEngine(options), formula(formula) {}
+
+    const char* name() const override { return formula == MachinFormula::Takano ? "takano" : "machin"; }
+
+    bool supports(DigitRadix radix) const override { return radix == DigitRadix::Decimal; }
+
+    unsigned long long memoryEstimate(const DigitRequest& request) const override {
+        unsigned long long limbs = 1 + (request.count + 8) / 9 + MACHIN_GUARD_LIMBS;
+        unsigned long long series = machinTerms(formula).size();
+        unsigned long long running = std::min<unsigned long long>(series, std::max(1u, settings.threads));
+        return saturatingAdd(saturatingMultiply(limbs, sizeof(int64_t) * (series + 1) +
+                                                       (sizeof(uint32_t) + sizeof(int64_t)) * running),
+                             request.count + 2);
+    }
+
+protected:
+    void run(const DigitRequest& request, const DigitSink& sink) override {
+        std::string digits = calculatePiDigitsMachin(static_cast<long long>(request.count), formula, settings.threads);
+        sink(digits.data(), digits.size());
+    }
+
+private:
+    MachinFormula formula;
+};
+
+class ChudnovskyDigitEngine : public DigitEngine {
+public:
+    explicit ChudnovskyDigitEngine(const EngineOptions& options) : DigitEngine(options) {}
+
+    const char* name() const override { return "chudnovsky"; }
+
+    bool supports(DigitRadix radix) const override { return radix == DigitRadix::Decimal; }
+
+    unsigned long long memoryEstimate(const DigitRequest& request) const override {
+        return saturatingAdd(saturatingMultiply(CHUDNOVSKY_BYTES_PER_DIGIT, request.count), 2);
+    }
+
+protected:
+    void run(const DigitRequest& request, const DigitSink& sink) override {
+        bool own = settings.threads > 1 && TaskScheduler::current() == nullptr;
+        std::unique_ptr<TaskScheduler> scheduler(own ? new TaskScheduler(settings.threads) : nullptr);
+        std::string digits = calculatePiDigitsChudnovsky(static_cast<long long>(request.count), series, settings.nodes);
+        sink(digits.data(), digits.size());
+    }
+
+private:
+    ChudnovskySeries series;
+};
+
+class BbpDigitEngine : public DigitEngine {
+public:
+    explicit BbpDigitEngine(const EngineOptions& options) : DigitEngine(options) {}
+
+    const char* name() const override { return "bbp"; }
+
+    bool supports(DigitRadix radix) const override { return radix != DigitRadix::Decimal; }
+
+    unsigned long long memoryEstimate(const DigitRequest& request) const override {
+        return saturatingMultiply(2, request.count);
+    }
+
+protected:
+    void run(const DigitRequest& request, const DigitSink& sink) override {
+        size_t count = static_cast<size_t>(request.count);
+        std::string digits = (request.radix == DigitRadix::Binary)
+            ? calculatePiBinaryDigits(request.offset, count, settings.threads)
+            : calculatePiHexDigits(request.offset, count, settings.threads);
+        sink(digits.data(), digits.size());
+    }
+};
+
+std::unique_ptr<DigitEngine> makeDigitEngine(PiEngine engine, const EngineOptions& options) {
+    switch (engine) {
+    case PiEngine::Chudnovsky:
+        return std::unique_ptr<DigitEngine>(new ChudnovskyDigitEngine(options));
+    case PiEngine::Machin:
+        return std::unique_ptr<DigitEngine>(new MachinDigitEngine(MachinFormula::Machin, options));
+    case PiEngine::Takano:
+        return std::unique_ptr<DigitEngine>(new MachinDigitEngine(MachinFormula::Takano, options));
+    case PiEngine::Spigot:
+    case PiEngine::SpigotLimb4:
+    case PiEngine::SpigotLimb9:
+    default:
+        return std::unique_ptr<DigitEngine>(new SpigotDigitEngine(engine, options));
+    }
+}
+
+std::unique_ptr<DigitEngine> makeBbpEngine(const EngineOptions& options) {
+    return std::unique_ptr<DigitEngine>(new BbpDigitEngine(options));
+}
+
+/*
+* Digit Cache:
+* ------------
+* `PiDigitCache` keeps the longest expansion computed so far in a file that is
+* memory-mapped read-only:
+*     [PiDigitCacheHeader][ "3." and `digits` decimals in ASCII ]
+* The header records the decimal count and an FNV-1a checksum of the payload; a file
+* whose size, magic or checksum does not match is treated as empty. The digits are
+* kept as ASCII rather than packed so that `view(n)` can hand out a pointer straight
+* into the mapping: a cached prefix costs no computation and no copy.
+* `cachedPiDigits` answers from the cache when it holds at least n decimals; otherwise
+* it computes n decimals, stores them(temporary file plus rename, so readers never see
+* a half-written cache) and answers from the new mapping. The spigot has to start over
+* for a larger n; with a Chudnovsky series file(`--series`) only the new terms are
+* computed. A store replaces the mapping, so earlier views become invalid.
+*/
+const char PI_DIGIT_CACHE_MAGIC[8] = { 'P', 'I', 'T', 'I', 'M', 'E', 'D', '1' };
+
+struct PiDigitCacheHeader {
+    char magic[8];
+    uint64_t digits;
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+PiDigitCache::PiDigitCache(const std::string& path) : path(path), file(new MappedFile()), cached_digits(-1) {
+    load();
+}
+
+PiDigitCache::~PiDigitCache() {}
+
+PiDigitsView PiDigitCache::view(long long n) const {
+    PiDigitsView result = { file->data() + sizeof(PiDigitCacheHeader), static_cast<size_t>(n) + 2 };
+    return result;
+}
+
+void PiDigitCache::store(const std::string& digits) {
+    PiDigitCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, PI_DIGIT_CACHE_MAGIC, sizeof(header.magic));
+    header.digits = digits.size() - 2;
+    header.checksum = fnv1a64(digits.data(), digits.size());
+
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(digits.data(), static_cast<std::streamsize>(digits.size()));
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("cannot write '" + temporary + "'");
+        }
+    }
+    file->close();
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("cannot replace '" + path + "': " + std::strerror(errno));
+    }
+    load();
+}
+
+void PiDigitCache::load() {
+    cached_digits = -1;
+    file->close();
+    // Too short for a header and "3." (an empty file included): nothing cached, and
+    // nothing to map.
+    std::ifstream probe(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!probe || probe.tellg() < static_cast<std::streamoff>(sizeof(PiDigitCacheHeader) + 2)) {
+        return;
+    }
+    probe.close();
+    file->open(path, false);
+
+    PiDigitCacheHeader header;
+    if (file->size() < sizeof(header) + 2) {
+        file->close();
+        return;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    const char* payload = file->data() + sizeof(header);
+    if (std::memcmp(header.magic, PI_DIGIT_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.digits != file->size() - sizeof(header) - 2 ||
+        header.checksum != fnv1a64(payload, file->size() - sizeof(header))) {
+        file->close();
+        return;
+    }
+    cached_digits = static_cast<long long>(header.digits);
+}
+
+PiDigitsView cachedPiDigits(PiDigitCache& cache, long long n, const std::function<std::string(long long)>& compute) {
+    n = std::max(n, 0LL);
+    if (cache.digitCount() < n) {
+        cache.store(compute(n));
+    }
+    return cache.view(n);
+}
+
+PiDigitsView cachedPiDigits(PiDigitCache& cache, long long n, PiEngine engine, const SpigotOptions& options) {
+    return cachedPiDigits(cache, n, [engine, &options](long long digits) {
+        return calculatePiDigitsString(digits, engine, options);
+    });
+}
+
+/*
+* Verification:
+* -------------
+* Three independent checks of a decimal result, all far cheaper than a second O(n^2)
+* spigot run:
+* - Reference file(`DigitComparator` fed by `DigitFileVerifier`): the output is
+*   compared, while it streams out, with a known-good digit file read in chunks of
+*   `VERIFY_CHUNK_BYTES`. Nothing but one chunk is held in memory. `firstDifference`
+*   is the comparison kernel: AVX2 compares 32 bytes per step(runtime dispatch, like
+*   the SIMD sweep), and elsewhere memcmp finds the differing block.
+* - Second formula(`--verify ENGINE`): another engine computes the same digits on its
+*   own thread while the main run is going, and the two strings go through the same
+*   comparator.
+* - BBP spot-check(`verifyPiDigitsBbp`): the first m decimals give D = floor(pi * 10^m),
+*   so X = floor(D * 16^(p+16) / 10^m) ends in the hex digits p..p+15 of pi, with p
+*   chosen as late as the precision of D allows. Truncating pi to D moves pi * 16^(p+16)
+*   by less than 2^-32, so the true value is X or X + 1, and the BBP digits at p must
+*   match one of them. One check costs a decimal-to-binary conversion and one division,
+*   O(M(n) log n). A failed check at m = n is bisected over shorter prefixes down to
+*   `VERIFY_BBP_RESOLUTION` decimals, which locates the first wrong digit without a
+*   second decimal computation. The 2^-32 slack leaves the last
+*   `VERIFY_BBP_BLIND_DIGITS` decimals of a prefix outside what its check can see.
+* Mismatches are reported by position: index 0 is the "3", index 1 the point, and
+* decimal d(1-based) sits at index d + 1.
+*/
+const size_t VERIFY_CHUNK_BYTES = size_t(1) << 20;
+const size_t VERIFY_MAX_REPORTED = 10;
+const long long VERIFY_BBP_RESOLUTION = 64;
+const long long VERIFY_BBP_BLIND_DIGITS = 10;
+
+size_t firstDifferencePortable(const char* a, const char* b, size_t count) {
+    const size_t block = 4096;
+    size_t i = 0;
+    while (i < count) {
+        size_t length = std::min(block, count - i);
+        if (std::memcmp(a + i, b + i, length) != 0) {
+            while (a[i] == b[i]) {
+                ++i;
+            }
+            return i;
+        }
+        i += length;
+    }
+    return count;
+}
+
+#ifdef PITIME_HAVE_AVX2_KERNEL
+__attribute__((target("avx2"))) size_t firstDifferenceAvx2(const char* a, const char* b, size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        unsigned equal = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (equal != 0xFFFFFFFFu) {
+            return i + static_cast<size_t>(__builtin_ctz(~equal));
+        }
+    }
+    for (; i < count; ++i) {
+        if (a[i] != b[i]) {
+            return i;
+        }
+    }
+    return count;
+}
+#endif
+
+// Index of the first byte where a and b differ, or `count` when they are equal.
+size_t firstDifference(const char* a, const char* b, size_t count) {
+#ifdef PITIME_HAVE_AVX2_KERNEL
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return firstDifferenceAvx2(a, b, count);
+    }
+#endif
+    return firstDifferencePortable(a, b, count);
+}
+
+void DigitComparator::compare(const char* got, const char* expected, size_t count) {
+    size_t i = 0;
+    while ((i += firstDifference(got + i, expected + i, count - i)) < count) {
+        record(compared + i, got[i], expected[i]);
+        ++i;
+    }
+    compared += count;
+}
+
+void DigitComparator::referenceEnded(const char* got, size_t count) {
+    if (count > 0 && !reference_short) {
+        reference_short = true;
+        record(compared, got[0], 0);
+    }
+    compared += count;
+}
+
+void DigitComparator::record(unsigned long long index, char got, char expected) {
+    ++mismatch_count;
+    if (mismatches.size() < VERIFY_MAX_REPORTED) {
+        DigitMismatch mismatch = { index, got, expected };
+        mismatches.push_back(mismatch);
+    }
+}
+
+DigitFileVerifier::DigitFileVerifier(const std::string& path) : in(path.c_str(), std::ios::binary), chunk(VERIFY_CHUNK_BYTES) {
+    if (!in) {
+        throw std::runtime_error("cannot open reference file '" + path + "'");
+    }
+}
+
+void DigitFileVerifier::feed(const char* digits, size_t count) {
+    while (count > 0) {
+        size_t length = std::min(count, chunk.size());
+        in.read(chunk.data(), static_cast<std::streamsize>(length));
+        size_t available = static_cast<size_t>(in.gcount());
+        comparator.compare(digits, chunk.data(), available);
+        if (available < length) {
+            comparator.referenceEnded(digits + available, count - available);
+            return;
+        }
+        digits += length;
+        count -= length;
+    }
+}
+
+void writeVerificationReport(std::ostream& out, const std::string& against, const DigitComparator& comparator) {
+    out << "Verification against " << against << ": ";
+    if (comparator.ok()) {
+        out << "OK(" << comparator.comparedCount() << " characters)" << std::endl;
+        return;
+    }
+    out << comparator.mismatchCount() << " mismatching characters of " << comparator.comparedCount() << std::endl;
+    for (const DigitMismatch& mismatch : comparator.reported()) {
+        out << "  index " << mismatch.index;
+        if (mismatch.index >= 2) {
+            out << "(decimal " << mismatch.index - 1 << ")";
+        }
+        if (mismatch.expected == 0) {
+            out << ": the reference ends here" << std::endl;
+        }
+        else {
+            out << ": got '" << mismatch.got << "', expected '" << mismatch.expected << "'" << std::endl;
+        }
+    }
+    if (comparator.mismatchCount() > comparator.reported().size()) {
+        out << "  ..." << std::endl;
+    }
+}
+
+// Hex position p whose digits p..p+15 the first m decimals determine, or -1.
+long long bbpCheckPosition(long long m) {
+    long long bits = static_cast<long long>(m * 3.3219280948873623) - 32;
+    return bits / 4 - static_cast<long long>(BBP_CHUNK_DIGITS);
+}
+
+// Whether the first m decimals of "3.xxxx" agree with the BBP hex digits near 0.83 m.
+bool bbpPrefixAgrees(const std::string& digits, long long m, unsigned threads) {
+    long long position = bbpCheckPosition(m);
+    std::string prefix = "3" + digits.substr(2, static_cast<size_t>(m));
+    BigInt scaled = BigInt::fromDecimalString(prefix.data(), prefix.size());
+    scaled <<= static_cast<size_t>(4 * (position + static_cast<long long>(BBP_CHUNK_DIGITS)));
+    BigInt x = BigInt::divide(scaled, BigInt::pow(10, static_cast<unsigned long long>(m)));
+    unsigned long long low = x.lowBits();
+    std::string expected = calculatePiHexDigits(static_cast<unsigned long long>(position), BBP_CHUNK_DIGITS, threads);
+    for (int candidate = 0; candidate < 2; ++candidate) {
+        std::ostringstream hex;
+        hex << std::hex << std::uppercase << std::setw(16) << std::setfill('0') << (low + static_cast<unsigned long long>(candidate));
+        if (hex.str() == expected) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BbpVerification verifyPiDigitsBbp(const std::string& digits, unsigned threads) {
+    BbpVerification result = { false, true, -1, 0, 0 };
+    long long n = static_cast<long long>(digits.size()) - 2;
+    if (n <= 0 || digits.compare(0, 2, "3.") != 0 || bbpCheckPosition(n) < 0) {
+        return result;
+    }
+    result.checked = true;
+    result.hex_position = bbpCheckPosition(n);
+    if (bbpPrefixAgrees(digits, n, threads)) {
+        return result;
+    }
+    result.ok = false;
+    // Prefixes that end before the first wrong decimal agree; bisect for the boundary.
+    long long good = 0, bad = n;
+    while (bad - good > VERIFY_BBP_RESOLUTION) {
+        long long middle = good + (bad - good) / 2;
+        if (bbpCheckPosition(middle) >= 0 && bbpPrefixAgrees(digits, middle, threads)) {
+            good = middle;
+        }
+        else {
+            bad = middle;
+        }
+    }
+    result.first_bad_from = std::max(0LL, good - VERIFY_BBP_BLIND_DIGITS);
+    result.first_bad_to = bad;
+    return result;
+}
+
+void writeBbpVerificationReport(std::ostream& out, const BbpVerification& result) {
+    out << "Verification against BBP: ";
+    if (!result.checked) {
+        out << "skipped(too few digits for a hex spot-check)" << std::endl;
+    }
+    else if (result.ok) {
+        out << "OK(hex digits " << result.hex_position << ".." << result.hex_position + BBP_CHUNK_DIGITS - 1
+            << ")" << std::endl;
+    }
+    else {
+        out << "MISMATCH at hex digits " << result.hex_position << ".."
+            << result.hex_position + BBP_CHUNK_DIGITS - 1 << "; the first wrong decimal is between "
+            << result.first_bad_from + 1 << " and " << result.first_bad_to << std::endl;
+    }
+}
+
+/*
+* Digit Output:
+* -------------
+* `DigitWriter` is the output path of a run: it writes to a file descriptor(standard
+* output or the `-o` file) with write/writev calls instead of going through iostreams.
+* - Plain output: chunks of at least `OUTPUT_DIRECT_BYTES` are written straight from
+*   the engine's buffer, in one writev together with whatever is still staged, so a
+*   Chudnovsky or cached result of any size is never copied. Smaller chunks(the spigot
+*   confirms a few digits at a time) are staged in a buffer of `OUTPUT_BUFFER_BYTES`.
+* - Formatted output(`DigitLayout`): the decimals after "3." are split into groups of
+*   `group` digits separated by a space and lines of `line` digits separated by a
+*   newline. The layout is applied in a single pass that copies whole groups into the
+*   staging buffer, so formatting costs one memcpy per group.
+* Staged output is written when the buffer fills, when `OUTPUT_FLUSH_INTERVAL` has passed
+* since the last write(so that a slow spigot run still shows its digits as they come)
+* and at `finish`, which also ends the output with a newline. Write errors throw.
+* An mmap'd output file would save nothing over this: write copies from the digit buffer
+* into the page cache once, just as stores into a mapping would, and a mapping needs
+* the final size up front, which a streamed run does not know.
+*/
+const size_t OUTPUT_BUFFER_BYTES = 1 << 20;
+const size_t OUTPUT_DIRECT_BYTES = 1 << 16;
+const std::chrono::milliseconds OUTPUT_FLUSH_INTERVAL(200);
+const size_t DIGIT_LAYOUT_PREFIX = 2;  // "3." is never formatted
+
+DigitWriter::DigitWriter(const std::string& path, const DigitLayout& layout)
+    : name(path.empty() ? "standard output" : "'" + path + "'"), layout(layout), buffer(OUTPUT_BUFFER_BYTES),
+      used(0), received(0), last_write(std::chrono::steady_clock::now()) {
+#ifdef _WIN32
+    file = path.empty() ? stdout : std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("cannot open output file " + name);
+    }
+#else
+    fd = path.empty() ? STDOUT_FILENO : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open output file " + name + ": " + std::strerror(errno));
+    }
+#endif
+}
+
+DigitWriter::~DigitWriter() {
+    try {
+        flush();
+    }
+    catch (const std::exception&) {
+    }
+#ifdef _WIN32
+    if (file != stdout) {
+        std::fclose(file);
+    }
+#else
+    if (fd != STDOUT_FILENO) {
+        ::close(fd);
+    }
+#endif
+}
+
+void DigitWriter::write(const char* data, size_t count) {
+    if (layout.plain()) {
+        if (count >= OUTPUT_DIRECT_BYTES) {
+            writeOut(data, count);
+        }
+        else {
+            if (count > buffer.size() - used) {
+                flush();
+            }
+            std::memcpy(buffer.data() + used, data, count);
+            used += count;
+        }
+        received += count;
+    }
+    else {
+        writeFormatted(data, count);
+    }
+    if (used > 0 && std::chrono::steady_clock::now() - last_write >= OUTPUT_FLUSH_INTERVAL) {
+        flush();
+    }
+}
+
+void DigitWriter::flush() {
+    if (used > 0) {
+        writeOut(nullptr, 0);
+    }
+}
+
+void DigitWriter::finish() {
+    if (used == buffer.size()) {
+        flush();
+    }
+    buffer[used++] = '\n';
+    flush();
+}
+
+void DigitWriter::writeFormatted(const char* data, size_t count) {
+    while (count > 0 && received < DIGIT_LAYOUT_PREFIX) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = *data++;
+        --count;
+        ++received;
+    }
+    while (count > 0) {
+        if (buffer.size() - used < 2) {
+            flush();
+        }
+        unsigned long long decimal = received - DIGIT_LAYOUT_PREFIX;
+        unsigned long long in_line = layout.line ? decimal % layout.line : decimal;
+        if (decimal > 0 && layout.line && in_line == 0) {
+            buffer[used++] = '\n';
+        }
+        else if (decimal > 0 && layout.group && in_line % layout.group == 0) {
+            buffer[used++] = ' ';
+        }
+        unsigned long long boundary = std::numeric_limits<unsigned long long>::max();
+        if (layout.group) {
+            boundary = (in_line / layout.group + 1) * layout.group;
+        }
+        if (layout.line) {
+            boundary = std::min<unsigned long long>(boundary, layout.line);
+        }
+        size_t span = static_cast<size_t>(std::min<unsigned long long>(boundary - in_line, count));
+        span = std::min(span, buffer.size() - used);
+        std::memcpy(buffer.data() + used, data, span);
+        used += span;
+        data += span;
+        count -= span;
+        received += span;
+    }
+}
+
+void DigitWriter::writeOut(const char* data, size_t count) {
+#ifdef _WIN32
+    if ((used > 0 && std::fwrite(buffer.data(), 1, used, file) != used) ||
+        (count > 0 && std::fwrite(data, 1, count, file) != count) || std::fflush(file) != 0) {
+        throw std::runtime_error("cannot write to " + name);
+    }
+#else
+    struct iovec pieces[2] = { { buffer.data(), used }, { const_cast<char*>(data), count } };
+    struct iovec* next = pieces;
+    int left = 2;
+    while (left > 0) {
+        if (next->iov_len == 0) {
+            ++next;
+            --left;
+            continue;
+        }
+        ssize_t written = ::writev(fd, next, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("cannot write to " + name + ": " + std::strerror(errno));
+        }
+        size_t done = static_cast<size_t>(written);
+        while (left > 0 && done >= next->iov_len) {
+            done -= next->iov_len;
+            ++next;
+            --left;
+        }
+        if (left > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + done;
+            next->iov_len -= done;
+        }
+    }
+#endif
+    used = 0;
+    last_write = std::chrono::steady_clock::now();
+}
+
+/*
+* Digit Server:
+* -------------
+* `SharedPiDigits` holds one expansion in a buffer shared by every request. The first
+* `available` characters are final; a request copies nothing and hands its sink
+* pointers into the buffer, outside the lock, so a slow client never holds up the
+* computation or the other clients.
+* - Coalescing: a request for more than is available raises `wanted`. The computation
+*   thread starts a run for `wanted` decimals whenever it is idle and `wanted` is not
+*   yet available, so every request that arrives during a run and needs no more than
+*   its target attaches to it, and every longer one to the single next run, sized to
+*   the largest of them.
+* - Streaming: a run publishes its progress every `SHARED_PUBLISH_BYTES` or
+*   `OUTPUT_FLUSH_INTERVAL`, whichever comes first, and at the end, and wakes the
+*   waiting requests, which send on whatever part of their prefix has become
+*   available. The expansion of pi does not depend on n, so a run skips the part that
+*   is already known instead of copying it again.
+* - The buffer is allocated at the size of a run once its engine has accepted the
+*   request, and is replaced rather than resized; requests keep the buffer they are
+*   reading from alive with a shared_ptr.
+* - A failed run fails the requests waiting for it. Requests beyond `max_digits`, the
+*   range of `DigitEngine::stream` or the memory limit(by the engine's estimate) are
+*   refused before anything is sent; the cap keeps a server without a memory limit
+*   from starting a computation of any size a client names.
+* The Chudnovsky engine keeps its series between runs, so the next, longer run only
+* splits the new terms; the spigot engines stream digits as soon as they are
+* confirmed, which suits clients that read their prefix as it comes.
+*
+* `DigitServer` speaks a line protocol on a Unix or TCP stream socket: every line a
+* client sends is a decimal count N, answered with "3." and N decimals and a newline,
+* in the order of the requests; empty lines are ignored. Invalid or refused requests
+* are answered with "error: ..." and the connection stays open. A response that ends
+* without its newline means the computation failed after the answer had started.
+* Each connection is served by a thread of its own. With `use_table` the expansion
+* starts out as `PI_TABLE`, so short requests never wait for a computation.
+*
+* `SocketAcceptor` owns the listening socket and the connection threads: it serves at
+* most `SERVER_MAX_CONNECTIONS` at once and leaves the rest in the listen backlog. When
+* accept fails for lack of descriptors, buffers or memory, or a thread cannot be
+* started, it retries after `SERVER_ACCEPT_BACKOFF` instead of giving up. A self-pipe
+* wakes its poll for `stop`, which shuts down every connection and joins its thread
+* before returning. `DigitServer::stop` stops the `SharedPiDigits` first, so the
+* threads waiting for digits return as well and nothing runs on once the server and
+* its digits are destroyed.
+*/
+const size_t SHARED_PUBLISH_BYTES = 1 << 12;
+const size_t SERVER_MAX_LINE = 64;
+const size_t SERVER_MAX_CONNECTIONS = 256;
+const std::chrono::milliseconds SERVER_ACCEPT_BACKOFF(100);
+
+SharedPiDigits::SharedPiDigits(PiEngine engine, const EngineOptions& options, long long max_digits)
+    : engine(makeDigitEngine(engine, options)), max_digits(max_digits), buffer(std::make_shared<std::vector<char>>()), available(0),
+      wanted(-1), target(-1), running(false), started_runs(0), failed_run(0), stopping(false) {
+    if (options.use_table) {
+        buffer->assign(PI_TABLE, PI_TABLE + PI_TABLE_DIGITS + 2);
+        available = buffer->size();
+        wanted = static_cast<long long>(PI_TABLE_DIGITS);
+    }
+    worker = std::thread(&SharedPiDigits::compute, this);
+}
+
+SharedPiDigits::~SharedPiDigits() {
+    stop();
+    worker.join();
+}
+
+void SharedPiDigits::stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    digits_ready.notify_all();
+}
+
+long long SharedPiDigits::digitCount() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return available < 2 ? -1 : static_cast<long long>(available) - 2;
+}
+
+void SharedPiDigits::request(long long n, const DigitSink& sink) {
+    if (n < 0) {
+        throw std::invalid_argument("negative digit count");
+    }
+    if (n > std::numeric_limits<long long>::max() / 4) {
+        throw std::invalid_argument("digit count out of range");  // as in DigitEngine::stream
+    }
+    if (n > max_digits) {
+        throw std::length_error(std::to_string(n) + " digits are more than the maximum of " +
+                                std::to_string(max_digits));
+    }
+    size_t needed = static_cast<size_t>(n) + 2;
+    std::unique_lock<std::mutex> guard(mutex);
+    if (needed > available) {
+        DigitRequest request = DigitRequest::decimals(static_cast<unsigned long long>(n));
+        unsigned long long limit = engine->options().memory_limit;
+        unsigned long long estimate = saturatingAdd(engine->memoryEstimate(request), request.count + 2);  // and the shared buffer
+        if (limit != 0 && estimate > limit) {
+            throw std::length_error(std::string("the ") + engine->name() + " engine needs about " +
+                                    std::to_string(estimate) + " bytes for " + std::to_string(n) +
+                                    " digits, more than the limit of " + std::to_string(limit));
+        }
+        if (n > wanted) {
+            wanted = n;
+            work_ready.notify_one();
+        }
+    }
+    // The run that delivers the last digit: the one in flight if it goes that far,
+    // otherwise the next one, which starts with `wanted` >= n.
+    unsigned long long covering_run = (running && target >= n) ? started_runs : started_runs + 1;
+    size_t sent = 0;
+    while (true) {
+        size_t ready = std::min(available, needed);
+        if (sent < ready) {
+            std::shared_ptr<std::vector<char>> digits = buffer;
+            guard.unlock();
+            sink(digits->data() + sent, ready - sent);
+            sent = ready;
+            guard.lock();
+            continue;
+        }
+        if (sent == needed) {
+            return;
+        }
+        if (failed_run >= covering_run) {
+            throw std::runtime_error(failure);
+        }
+        if (stopping) {
+            throw std::runtime_error("the shared digits were stopped");
+        }
+        digits_ready.wait(guard);
+    }
+}
+
+void SharedPiDigits::compute() {
+    std::unique_lock<std::mutex> guard(mutex);
+    while (true) {
+        work_ready.wait(guard, [this]() {
+            return stopping || (wanted >= 0 && static_cast<size_t>(wanted) + 2 > available);
+        });
+        if (stopping) {
+            return;
+        }
+        target = wanted;
+        ++started_runs;
+        running = true;
+        size_t known = available;
+        size_t needed = static_cast<size_t>(target) + 2;
+        std::shared_ptr<std::vector<char>> digits = buffer;
+        guard.unlock();
+        try {
+            size_t position = 0;
+            size_t published = known;
+            std::chrono::steady_clock::time_point last_publish = std::chrono::steady_clock::now();
+            engine->stream(DigitRequest::decimals(static_cast<unsigned long long>(target)),
+                           [&](const char* data, size_t count) {
+                size_t skip = (position < known) ? std::min(count, known - position) : 0;
+                position += count;
+                if (skip == count) {
+                    return;
+                }
+                if (position > needed) {
+                    throw std::runtime_error(std::string("the ") + engine->name() + " engine produced too many digits");
+                }
+                if (digits->size() < needed) {
+                    std::shared_ptr<std::vector<char>> grown = std::make_shared<std::vector<char>>(needed);
+                    std::memcpy(grown->data(), digits->data(), known);
+                    digits = grown;
+                    std::lock_guard<std::mutex> swap(mutex);
+                    buffer = digits;
+                }
+                std::memcpy(digits->data() + position - count + skip, data + skip, count - skip);
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (position - published >= SHARED_PUBLISH_BYTES || position == needed ||
+                    now - last_publish >= OUTPUT_FLUSH_INTERVAL) {
+                    {
+                        std::lock_guard<std::mutex> publish(mutex);
+                        if (stopping) {
+                            throw std::runtime_error("the shared digits were stopped");
+                        }
+                        available = position;
+                    }
+                    published = position;
+                    last_publish = now;
+                    digits_ready.notify_all();
+                }
+            });
+            if (position != needed) {
+                throw std::runtime_error(std::string("the ") + engine->name() + " engine stopped short");
+            }
+            guard.lock();
+        }
+        catch (const std::exception& error) {
+            guard.lock();
+            failure = error.what();
+            failed_run = started_runs;
+            if (wanted <= target) {
+                wanted = std::max(-1LL, static_cast<long long>(available) - 2);
+            }
+        }
+        running = false;
+        digits_ready.notify_all();
+    }
+}
+
+#ifndef _WIN32
+namespace {
+
+bool parseDigitCount(const std::string& text, long long& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(text.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+void sendAll(int connection, const char* data, size_t count) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (count > 0) {
+        ssize_t sent = ::send(connection, data, count, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("cannot send: ") + std::strerror(errno));
+        }
+        data += sent;
+        count -= static_cast<size_t>(sent);
+    }
+}
+
+// A listening socket on `address`: a Unix socket path(anything containing '/') or a
+// TCP "[HOST:]PORT". `unix_path` is set to the path of a Unix socket.
+int listenOn(const std::string& address, std::string& unix_path) {
+    int listener = -1;
+    auto fail = [&](const std::string& what) {
+        std::string reason = std::strerror(errno);
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        throw std::runtime_error("cannot " + what + " '" + address + "': " + reason);
+    };
+    if (address.find('/') != std::string::npos) {
+        sockaddr_un local;
+        std::memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(local.sun_path)) {
+            throw std::runtime_error("socket path '" + address + "' is too long");
+        }
+        std::memcpy(local.sun_path, address.c_str(), address.size() + 1);
+        // A socket left behind by an earlier server is replaced, any other file is not.
+        struct stat existing;
+        if (::stat(address.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+            ::unlink(address.c_str());
+        }
+        listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            fail("create a socket for");
+        }
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            fail("bind to");
+        }
+        unix_path = address;
+    }
+    else {
+        size_t colon = address.rfind(':');
+        std::string host = (colon == std::string::npos) ? std::string() : address.substr(0, colon);
+        std::string port = (colon == std::string::npos) ? address : address.substr(colon + 1);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* found = nullptr;
+        int status = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+        if (status != 0) {
+            throw std::runtime_error("cannot resolve '" + address + "': " + ::gai_strerror(status));
+        }
+        for (addrinfo* candidate = found; candidate != nullptr && listener < 0; candidate = candidate->ai_next) {
+            listener = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (listener < 0) {
+                continue;
+            }
+            int reuse = 1;
+            ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (::bind(listener, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+                int error = errno;
+                ::close(listener);
+                listener = -1;
+                errno = error;
+            }
+        }
+        ::freeaddrinfo(found);
+        if (listener < 0) {
+            fail("bind to");
+        }
+    }
+    if (::listen(listener, SOMAXCONN) != 0) {
+        fail("listen on");
+    }
+    return listener;
+}
+
+// A connection to a listener of `listenOn`; a TCP address without a host is this machine.
+int connectTo(const std::string& address) {
+    int connection = -1;
+    if (address.find('/') != std::string::npos) {
+        sockaddr_un local;
+        std::memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(local.sun_path)) {
+            throw std::runtime_error("socket path '" + address + "' is too long");
+        }
+        std::memcpy(local.sun_path, address.c_str(), address.size() + 1);
+        connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connection >= 0 && ::connect(connection, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+            int error = errno;
+            ::close(connection);
+            connection = -1;
+            errno = error;
+        }
+    }
+    else {
+        size_t colon = address.rfind(':');
+        std::string host = (colon == std::string::npos) ? std::string() : address.substr(0, colon);
+        std::string port = (colon == std::string::npos) ? address : address.substr(colon + 1);
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        int status = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+        if (status != 0) {
+            throw std::runtime_error("cannot resolve '" + address + "': " + ::gai_strerror(status));
+        }
+        for (addrinfo* candidate = found; candidate != nullptr && connection < 0; candidate = candidate->ai_next) {
+            connection = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (connection >= 0 && ::connect(connection, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+                int error = errno;
+                ::close(connection);
+                connection = -1;
+                errno = error;
+            }
+        }
+        ::freeaddrinfo(found);
+    }
+    if (connection < 0) {
+        throw std::runtime_error("cannot connect to '" + address + "': " + std::strerror(errno));
+    }
+    return connection;
+}
+
+}  // namespace
+#endif
+
+SocketAcceptor::SocketAcceptor(const std::string& address, size_t max_connections)
+    : listen_address(address), listener(-1), max_connections(std::max<size_t>(1, max_connections)), next_id(0),
+      running(0), stopping(false) {
+    wake[0] = wake[1] = -1;
+#ifdef _WIN32
+    throw std::runtime_error("serving on '" + address + "' needs POSIX sockets");
+#else
+    listener = listenOn(address, unix_path);
+    if (::fcntl(listener, F_SETFL, ::fcntl(listener, F_GETFL) | O_NONBLOCK) != 0 || ::pipe(wake) != 0) {
+        std::string reason = std::strerror(errno);
+        ::close(listener);
+        if (!unix_path.empty()) {
+            ::unlink(unix_path.c_str());
+        }
+        throw std::runtime_error("cannot set up '" + address + "': " + reason);
+    }
+#endif
+}
+
+SocketAcceptor::~SocketAcceptor() {
+#ifndef _WIN32
+    stop();
+    ::close(listener);
+    ::close(wake[0]);
+    ::close(wake[1]);
+    if (!unix_path.empty()) {
+        ::unlink(unix_path.c_str());
+    }
+#endif
+}
+
+void SocketAcceptor::run(const std::function<void(int connection)>& serve) {
+#ifndef _WIN32
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            reap();
+            changed.wait(guard, [this]() { return stopping || running < max_connections; });
+            if (stopping) {
+                return;
+            }
+        }
+        pollfd waiting[2];
+        waiting[0].fd = listener;
+        waiting[1].fd = wake[0];
+        waiting[0].events = waiting[1].events = POLLIN;
+        waiting[0].revents = waiting[1].revents = 0;
+        if (::poll(waiting, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("cannot poll '" + listen_address + "': " + std::strerror(errno));
+        }
+        if (waiting[1].revents != 0) {
+            continue;  // stopped
+        }
+        int connection = ::accept(listener, nullptr, nullptr);
+        bool backoff = false;
+        if (connection < 0) {
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                backoff = true;
+            }
+            else if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;
+            }
+            else {
+                throw std::runtime_error("cannot accept on '" + listen_address + "': " + std::strerror(errno));
+            }
+        }
+        std::unique_lock<std::mutex> guard(mutex);
+        if (!backoff) {
+            // Accepted sockets inherit O_NONBLOCK on some systems; the servers block.
+            ::fcntl(connection, F_SETFL, ::fcntl(connection, F_GETFL) & ~O_NONBLOCK);
+            if (stopping) {
+                ::close(connection);
+                return;
+            }
+            unsigned long long id = next_id++;
+            Connection& entry = connections[id];
+            entry.fd = connection;
+            entry.done = false;
+            try {
+                entry.thread = std::thread(&SocketAcceptor::serveConnection, this, id, connection, serve);
+                ++running;
+            }
+            catch (const std::system_error&) {
+                ::close(connection);
+                connections.erase(id);
+                backoff = true;
+            }
+        }
+        if (backoff) {
+            // Out of descriptors, memory or threads: wait for connections to end, then retry.
+            changed.wait_for(guard, SERVER_ACCEPT_BACKOFF, [this]() { return stopping; });
+        }
+    }
+#else
+    (void)serve;
+#endif
+}
+
+void SocketAcceptor::stop() {
+#ifndef _WIN32
+    std::unique_lock<std::mutex> guard(mutex);
+    if (!stopping) {
+        stopping = true;
+        char byte = 0;
+        if (::write(wake[1], &byte, 1) < 0) {
+            // The pipe is never full: it is written once.
+        }
+    }
+    for (auto& entry : connections) {
+        if (entry.second.fd >= 0) {
+            ::shutdown(entry.second.fd, SHUT_RDWR);
+        }
+    }
+    changed.notify_all();
+    changed.wait(guard, [this]() { return running == 0; });
+    reap();
+#endif
+}
+
+void SocketAcceptor::serveConnection(unsigned long long id, int connection, std::function<void(int)> serve) {
+#ifndef _WIN32
+    try {
+        serve(connection);
+    }
+    catch (const std::exception&) {
+        // Whatever ended the connection ends only this one.
+    }
+    std::lock_guard<std::mutex> guard(mutex);
+    ::close(connection);
+    Connection& entry = connections[id];
+    entry.fd = -1;
+    entry.done = true;
+    --running;
+    changed.notify_all();
+#else
+    (void)id;
+    (void)connection;
+    (void)serve;
+#endif
+}
+
+// Joins the threads of the connections that have ended; called with `mutex` held.
+void SocketAcceptor::reap() {
+    for (auto entry = connections.begin(); entry != connections.end();) {
+        if (!entry->second.done) {
+            ++entry;
+            continue;
+        }
+        entry->second.thread.join();
+        entry = connections.erase(entry);
+    }
+}
+
+DigitServer::DigitServer(const std::string& address, SharedPiDigits& digits)
+    : digits(digits), acceptor(address, SERVER_MAX_CONNECTIONS) {}
+
+DigitServer::~DigitServer() {
+    stop();
+}
+
+void DigitServer::run() {
+    acceptor.run([this](int connection) { serve(connection); });
+}
+
+void DigitServer::stop() {
+    digits.stop();
+    acceptor.stop();
+}
+
+void DigitServer::serve(int connection) {
+#ifndef _WIN32
+    std::string pending;
+    char chunk[256];
+    try {
+        while (true) {
+            ssize_t got = ::recv(connection, chunk, sizeof(chunk), 0);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                break;
+            }
+            pending.append(chunk, static_cast<size_t>(got));
+            size_t end;
+            while ((end = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, end);
+                pending.erase(0, end + 1);
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (line.empty()) {
+                    continue;
+                }
+                long long n = 0;
+                std::string refusal;
+                if (!parseDigitCount(line, n)) {
+                    refusal = "invalid digit count '" + line + "'";
+                }
+                else {
+                    bool started = false;
+                    try {
+                        digits.request(n, [connection, &started](const char* data, size_t count) {
+                            started = true;
+                            sendAll(connection, data, count);
+                        });
+                    }
+                    catch (const std::exception& error) {
+                        if (started) {
+                            throw;
+                        }
+                        refusal = error.what();
+                    }
+                }
+                std::string ending = refusal.empty() ? "\n" : "error: " + refusal + "\n";
+                sendAll(connection, ending.data(), ending.size());
+            }
+            if (pending.size() > SERVER_MAX_LINE) {
+                std::string ending = "error: request line too long\n";
+                sendAll(connection, ending.data(), ending.size());
+                break;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        // The client went away or its computation failed part way; drop the connection.
+    }
+#else
+    (void)connection;
+#endif
+}
+
+/*
+* Distributed Binary Splitting:
+* -----------------------------
+* P, Q and T of a term range depend only on the range, and the merge of two adjacent
+* ranges only on their P, Q and T, so the binary-splitting tree can be cut anywhere into
+* contiguous subtrees that are split on other machines.
+* - `SplitWorker` listens on an address of the `DigitServer` form and answers split
+*   requests for term ranges [a,b). A `SocketAcceptor` serves up to
+*   `SPLIT_MAX_CONNECTIONS` coordinators, each on a thread of its own, but only
+*   `SPLIT_MAX_CONCURRENT` splits run at once; the others wait for a slot. A split runs
+*   `chudnovskySplit` on a `TaskScheduler` of `threads` workers created for it, so
+*   within a node the range is split by the same work-stealing scheduler as a local
+*   run, and the node's cores are not divided among coordinators.
+* - `chudnovskySplitDistributed` cuts [a,b) into `SPLIT_PIECES_PER_NODE` contiguous
+*   pieces of equal term count per node and keeps one connection per node, which takes
+*   the next piece whenever it has returned the last, so faster nodes split more of
+*   them. A node whose connection or computation fails is dropped and its piece goes
+*   back to the others; the split fails only when no node is left.
+* - The returned pieces are merged pairwise up a balanced tree on the caller's
+*   scheduler; merges of large operands run their products as tasks and their NTTs on
+*   all workers, as they do in `chudnovskySplit`.
+* Protocol(binary, one connection per coordinator and node, any number of requests on
+* it): the request is `SPLIT_REQUEST_MAGIC`, the uint32 `SPLIT_BYTE_ORDER_MARK`, one
+* byte with the limb width, int64 a, int64 b and one byte need_p, all in the
+* coordinator's byte order. The response is a status byte: `SPLIT_STATUS_WORKING`
+* every `SPLIT_HEARTBEAT` while the request waits or runs, then `SPLIT_STATUS_DONE`
+* followed by P, Q and T in `BigInt::writeBinary` form(P empty without need_p), or
+* `SPLIT_STATUS_FAILED` with a uint32 length and an error message. A worker whose byte
+* order or limb width differs from the mark answers `SPLIT_STATUS_INCOMPATIBLE` and
+* closes, since the limbs travel in native byte order; a different protocol version
+* fails the magic and is closed at once. The coordinator bounds every limb count by
+* `splitLimbBound` of the range, so a corrupt count cannot make it allocate beyond
+* the size of a real result. Nothing is authenticated: a worker belongs on a
+* cluster-internal address.
+* Failure detection: the coordinator gives up on a node that sends nothing for
+* `SPLIT_RESPONSE_TIMEOUT` seconds(several missed heartbeats), so a hung worker
+* process is dropped like a dead one, and TCP keepalive notices a vanished host
+* within about `SPLIT_KEEPALIVE_IDLE` + `SPLIT_KEEPALIVE_COUNT` *
+* `SPLIT_KEEPALIVE_INTERVAL` seconds on either side.
+* The merges near the root are the largest multiplications and stay on the
+* coordinator, which also needs memory for the whole result; the workers need only
+* their pieces. The pieces' bit sizes grow slowly with their position, so equal term
+* counts are close to equal work, and the extra pieces per node even out the rest.
+*/
+const int SPLIT_PIECES_PER_NODE = 2;
+const long long SPLIT_MAX_TERMS = 1LL << 50;
+const size_t SPLIT_STREAM_BUFFER = 1 << 16;
+const char SPLIT_REQUEST_MAGIC[8] = { 'P', 'I', 'T', 'I', 'M', 'E', 'J', '2' };
+const uint32_t SPLIT_BYTE_ORDER_MARK = 0x01020304;
+const char SPLIT_STATUS_DONE = 0;
+const char SPLIT_STATUS_FAILED = 1;
+const char SPLIT_STATUS_WORKING = 2;
+const char SPLIT_STATUS_INCOMPATIBLE = 3;
+const std::chrono::seconds SPLIT_HEARTBEAT(10);
+const int SPLIT_RESPONSE_TIMEOUT = 60;
+const int SPLIT_KEEPALIVE_IDLE = 30;
+const int SPLIT_KEEPALIVE_INTERVAL = 10;
+const int SPLIT_KEEPALIVE_COUNT = 3;
+const size_t SPLIT_MAX_CONNECTIONS = 64;
+const unsigned SPLIT_MAX_CONCURRENT = 1;
+
+#ifndef _WIN32
+namespace {
+
+// A buffered stream over a connected socket, so that `BigInt::readBinary` and
+// `writeBinary` work on the connection; long transfers bypass the buffers.
+class SocketStreamBuffer : public std::streambuf {
+public:
+    explicit SocketStreamBuffer(int connection)
+        : connection(connection), receive_error(0), input(SPLIT_STREAM_BUFFER), output(SPLIT_STREAM_BUFFER) {
+        setg(input.data(), input.data(), input.data());
+        setp(output.data(), output.data() + output.size());
+    }
+
+    // errno of the last failed receive; 0 after a clean end of stream.
+    int receiveError() const { return receive_error; }
+
+protected:
+    int_type underflow() override {
+        ssize_t got = receive(input.data(), input.size());
+        if (got <= 0) {
+            return traits_type::eof();
+        }
+        setg(input.data(), input.data(), input.data() + got);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    std::streamsize xsgetn(char* data, std::streamsize count) override {
+        std::streamsize done = std::min<std::streamsize>(count, egptr() - gptr());
+        std::memcpy(data, gptr(), static_cast<size_t>(done));
+        gbump(static_cast<int>(done));
+        while (done < count) {
+            if (count - done < static_cast<std::streamsize>(input.size())) {
+                if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+                    break;
+                }
+                std::streamsize part = std::min<std::streamsize>(count - done, egptr() - gptr());
+                std::memcpy(data + done, gptr(), static_cast<size_t>(part));
+                gbump(static_cast<int>(part));
+                done += part;
+                continue;
+            }
+            ssize_t got = receive(data + done, static_cast<size_t>(count - done));
+            if (got <= 0) {
+                break;
+            }
+            done += got;
+        }
+        return done;
+    }
+
+    int_type overflow(int_type c) override {
+        if (sync() != 0) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        if (count > epptr() - pptr() && sync() != 0) {
+            return 0;
+        }
+        if (count <= epptr() - pptr()) {
+            std::memcpy(pptr(), data, static_cast<size_t>(count));
+            pbump(static_cast<int>(count));
+            return count;
+        }
+        try {
+            sendAll(connection, data, static_cast<size_t>(count));
+        }
+        catch (const std::exception&) {
+            return 0;
+        }
+        return count;
+    }
+
+    int sync() override {
+        try {
+            sendAll(connection, pbase(), static_cast<size_t>(pptr() - pbase()));
+        }
+        catch (const std::exception&) {
+            return -1;
+        }
+        setp(output.data(), output.data() + output.size());
+        return 0;
+    }
+
+private:
+    int connection;
+    int receive_error;
+    std::vector<char> input;
+    std::vector<char> output;
+
+    ssize_t receive(char* data, size_t count) {
+        while (true) {
+            ssize_t got = ::recv(connection, data, count, 0);
+            if (got >= 0 || errno != EINTR) {
+                receive_error = (got < 0) ? errno : 0;
+                return got;
+            }
+        }
+    }
+};
+
+// Requests and responses go out whole, so Nagle's algorithm only adds delay; keepalive
+// notices a host that disappears in the middle of a long split. With
+// `timeout_seconds`, a receive or send that makes no progress for that long fails.
+// The TCP options fail harmlessly on Unix sockets.
+void tuneSplitConnection(int connection, int timeout_seconds) {
+    int enable = 1;
+    ::setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    ::setsockopt(connection, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+#ifdef TCP_KEEPIDLE
+    int idle = SPLIT_KEEPALIVE_IDLE;
+    ::setsockopt(connection, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#endif
+#ifdef TCP_KEEPINTVL
+    int interval = SPLIT_KEEPALIVE_INTERVAL;
+    ::setsockopt(connection, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+#ifdef TCP_KEEPCNT
+    int probes = SPLIT_KEEPALIVE_COUNT;
+    ::setsockopt(connection, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+#endif
+    if (timeout_seconds > 0) {
+        timeval timeout;
+        timeout.tv_sec = timeout_seconds;
+        timeout.tv_usec = 0;
+        ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+}
+
+// An upper bound on the limbs of P, Q or T of [a,b): every term multiplies them by
+// less than 2^(3 * log2(b) + 60), and the bound allows several times that.
+uint64_t splitLimbBound(long long a, long long b) {
+    uint64_t bits_per_term = 8 * (static_cast<uint64_t>(floorLog2(static_cast<unsigned long long>(b))) + 1) + 256;
+    return static_cast<uint64_t>(b - a) * bits_per_term / 32 + 64;
+}
+
+// Sends `SPLIT_STATUS_WORKING` every `SPLIT_HEARTBEAT` until destroyed, so that the
+// coordinator can tell a busy worker from a hung one. Nothing else may be sent on the
+// connection meanwhile.
+class SplitHeartbeat {
+public:
+    explicit SplitHeartbeat(int connection) : connection(connection), done(false), beat([this]() { run(); }) {}
+
+    ~SplitHeartbeat() {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            done = true;
+        }
+        wake.notify_all();
+        beat.join();
+    }
+
+private:
+    int connection;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool done;
+    std::thread beat;  // last: it uses the members above
+
+    void run() {
+        std::unique_lock<std::mutex> guard(mutex);
+        while (!wake.wait_for(guard, SPLIT_HEARTBEAT, [this]() { return done; })) {
+            try {
+                sendAll(connection, &SPLIT_STATUS_WORKING, 1);
+            }
+            catch (const std::exception&) {
+                return;  // the response will fail the same way
+            }
+        }
+    }
+};
+
+struct SplitPiece {
+    long long a, b;
+    BigInt P, Q, T;
+};
+
+std::string lostConnection(const SocketStreamBuffer& buffer) {
+    int error = buffer.receiveError();
+    if (error == EAGAIN || error == EWOULDBLOCK) {
+        return "no response for " + std::to_string(SPLIT_RESPONSE_TIMEOUT) + " seconds";
+    }
+    return error != 0 ? std::string("connection lost: ") + std::strerror(error) : std::string("connection lost");
+}
+
+// Sends the split request for `piece` and reads its P, Q and T back.
+void requestSplit(std::iostream& stream, const SocketStreamBuffer& buffer, SplitPiece& piece, bool need_p) {
+    int64_t range[2] = { piece.a, piece.b };
+    char limb_bytes = static_cast<char>(sizeof(BigInt::Limbs::value_type));
+    stream.write(SPLIT_REQUEST_MAGIC, sizeof(SPLIT_REQUEST_MAGIC));
+    stream.write(reinterpret_cast<const char*>(&SPLIT_BYTE_ORDER_MARK), sizeof(SPLIT_BYTE_ORDER_MARK));
+    stream.put(limb_bytes);
+    stream.write(reinterpret_cast<const char*>(range), sizeof(range));
+    stream.put(need_p ? 1 : 0);
+    if (!stream.flush()) {
+        throw std::runtime_error("cannot send the request");
+    }
+    char status = SPLIT_STATUS_WORKING;
+    while (status == SPLIT_STATUS_WORKING) {
+        if (!stream.get(status)) {
+            throw std::runtime_error(lostConnection(buffer));
+        }
+    }
+    if (status == SPLIT_STATUS_INCOMPATIBLE) {
+        throw std::runtime_error("the worker has a different byte order or limb width");
+    }
+    if (status == SPLIT_STATUS_FAILED) {
+        uint32_t length = 0;
+        stream.read(reinterpret_cast<char*>(&length), sizeof(length));
+        std::string message(stream ? std::min<uint32_t>(length, 1 << 16) : 0, '\0');
+        stream.read(&message[0], static_cast<std::streamsize>(message.size()));
+        throw std::runtime_error(stream ? message : lostConnection(buffer));
+    }
+    if (status != SPLIT_STATUS_DONE) {
+        throw std::runtime_error("unexpected response");
+    }
+    uint64_t max_limbs = splitLimbBound(piece.a, piece.b);
+    piece.P = BigInt::readBinary(stream, max_limbs);
+    piece.Q = BigInt::readBinary(stream, max_limbs);
+    piece.T = BigInt::readBinary(stream, max_limbs);
+}
+
+// Merges pieces[first, last) into pieces[first].
+void mergeSplitPieces(std::vector<SplitPiece>& pieces, size_t first, size_t last, bool need_p) {
+    if (last - first < 2) {
+        return;
+    }
+    size_t middle = first + (last - first) / 2;
+    TaskScheduler* scheduler = TaskScheduler::current();
+    if (scheduler) {
+        TaskGroup group(*scheduler);
+        group.spawn([&]() {
+            LimbArenaSuspend heap;
+            mergeSplitPieces(pieces, first, middle, true);
+        });
+        mergeSplitPieces(pieces, middle, last, need_p);
+        group.wait();
+    }
+    else {
+        mergeSplitPieces(pieces, first, middle, true);
+        mergeSplitPieces(pieces, middle, last, need_p);
+    }
+    SplitPiece& left = pieces[first];
+    SplitPiece& right = pieces[middle];
+    chudnovskyMerge(left.P, left.Q, left.T, right.P, right.Q, right.T, need_p, left.P, left.Q, left.T);
+    left.b = right.b;
+    right = SplitPiece();
+}
+
+}  // namespace
+#endif
+
+void chudnovskySplitDistributed(long long a, long long b, bool need_p, const std::vector<std::string>& nodes,
+                                BigInt& P, BigInt& Q, BigInt& T) {
+#ifdef _WIN32
+    (void)a;
+    (void)b;
+    (void)need_p;
+    (void)nodes;
+    (void)P;
+    (void)Q;
+    (void)T;
+    throw std::runtime_error("distributed splitting needs POSIX sockets");
+#else
+    long long count = std::min<long long>(b - a, static_cast<long long>(nodes.size()) * SPLIT_PIECES_PER_NODE);
+    std::vector<SplitPiece> pieces(static_cast<size_t>(count));
+    for (long long i = 0; i < count; ++i) {
+        pieces[i].a = a + (b - a) * i / count;
+        pieces[i].b = a + (b - a) * (i + 1) / count;
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<size_t> queue;
+    size_t in_flight = 0;
+    size_t done = 0;
+    std::string failure = "no split workers";
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        queue.push_back(i);
+    }
+    auto serveNode = [&](const std::string& node) {
+        int connection = -1;
+        try {
+            connection = connectTo(node);
+        }
+        catch (const std::exception& error) {
+            std::lock_guard<std::mutex> guard(mutex);
+            failure = error.what();
+            return;
+        }
+        tuneSplitConnection(connection, SPLIT_RESPONSE_TIMEOUT);
+        SocketStreamBuffer buffer(connection);
+        std::iostream stream(&buffer);
+        std::unique_lock<std::mutex> guard(mutex);
+        while (true) {
+            // A piece in flight elsewhere may still come back, so wait for it.
+            changed.wait(guard, [&]() { return !queue.empty() || in_flight == 0; });
+            if (queue.empty()) {
+                break;
+            }
+            size_t index = queue.front();
+            queue.pop_front();
+            ++in_flight;
+            guard.unlock();
+            std::string error;
+            try {
+                requestSplit(stream, buffer, pieces[index], need_p || index + 1 < pieces.size());
+            }
+            catch (const std::exception& problem) {
+                error = problem.what();
+            }
+            guard.lock();
+            --in_flight;
+            if (!error.empty()) {
+                queue.push_front(index);
+                failure = "split worker '" + node + "': " + error;
+                changed.notify_all();
+                break;
+            }
+            ++done;
+            changed.notify_all();
+        }
+        guard.unlock();
+        ::close(connection);
+    };
+    std::vector<std::thread> connections;
+    for (const std::string& node : nodes) {
+        connections.push_back(std::thread(serveNode, node));
+    }
+    for (std::thread& connection : connections) {
+        connection.join();
+    }
+    if (done != pieces.size()) {
+        throw std::runtime_error("distributed split failed: " + failure);
+    }
+
+    mergeSplitPieces(pieces, 0, pieces.size(), need_p);
+    P = std::move(pieces[0].P);
+    Q = std::move(pieces[0].Q);
+    T = std::move(pieces[0].T);
+#endif
+}
+
+SplitWorker::SplitWorker(const std::string& address, unsigned threads)
+    : threads(threads), active_splits(0), stopping(false), acceptor(address, SPLIT_MAX_CONNECTIONS) {}
+
+SplitWorker::~SplitWorker() {
+    stop();
+}
+
+void SplitWorker::run() {
+    acceptor.run([this](int connection) { serve(connection); });
+}
+
+void SplitWorker::stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    slot_free.notify_all();
+    acceptor.stop();
+}
+
+void SplitWorker::serve(int connection) {
+#ifndef _WIN32
+    tuneSplitConnection(connection, 0);
+    SocketStreamBuffer buffer(connection);
+    std::iostream stream(&buffer);
+    while (true) {
+        char magic[8];
+        uint32_t mark = 0;
+        char limb_bytes = 0;
+        int64_t range[2];
+        char need_p = 0;
+        stream.read(magic, sizeof(magic));
+        if (!stream || std::memcmp(magic, SPLIT_REQUEST_MAGIC, sizeof(magic)) != 0) {
+            return;  // the coordinator is done, or this is not one of this version
+        }
+        stream.read(reinterpret_cast<char*>(&mark), sizeof(mark));
+        stream.get(limb_bytes);
+        if (stream && (mark != SPLIT_BYTE_ORDER_MARK || limb_bytes != static_cast<char>(sizeof(BigInt::Limbs::value_type)))) {
+            stream.put(SPLIT_STATUS_INCOMPATIBLE);
+            stream.flush();
+            return;
+        }
+        stream.read(reinterpret_cast<char*>(range), sizeof(range));
+        stream.get(need_p);
+        if (!stream) {
+            return;
+        }
+        BigInt P, Q, T;
+        std::string refusal;
+        if (range[0] < 0 || range[1] <= range[0] || range[1] > SPLIT_MAX_TERMS) {
+            refusal = "invalid term range";
+        }
+        else {
+            SplitHeartbeat heartbeat(connection);
+            std::unique_lock<std::mutex> guard(mutex);
+            slot_free.wait(guard, [this]() { return stopping || active_splits < SPLIT_MAX_CONCURRENT; });
+            if (stopping) {
+                return;
+            }
+            ++active_splits;
+            guard.unlock();
+            try {
+                std::unique_ptr<TaskScheduler> scheduler(threads > 1 ? new TaskScheduler(threads) : nullptr);
+                chudnovskySplit(range[0], range[1], need_p != 0, P, Q, T);
+            }
+            catch (const std::exception& error) {
+                refusal = error.what();
+            }
+            guard.lock();
+            --active_splits;
+            slot_free.notify_one();
+        }
+        if (refusal.empty()) {
+            stream.put(SPLIT_STATUS_DONE);
+            P.writeBinary(stream);
+            Q.writeBinary(stream);
+            T.writeBinary(stream);
+        }
+        else {
+            uint32_t length = static_cast<uint32_t>(refusal.size());
+            stream.put(SPLIT_STATUS_FAILED);
+            stream.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            stream.write(refusal.data(), static_cast<std::streamsize>(refusal.size()));
+        }
+        if (!stream.flush()) {
+            return;
+        }
+    }
+#else
+    (void)connection;
+#endif
+}
+
+/*
+* Benchmark Harness:
+* ------------------
+* `runBenchmark` times one engine/kernel combination at one N: `warmup` untimed runs,
+* then `repetitions` timed runs on `steady_clock`. Statistics cover the timed runs only;
+* p95 is nearest-rank, so with fewer than 20 repetitions it equals the slowest run.
+* Digits per second is taken from the median. The report is CSV or JSON so results from
+* two builds can be diffed or fed to a script.
+*/
+const char* spigotKernelName(const SpigotOptions& options) {
+    if (options.simd) {
+        return "simd";
+    }
+    return options.division == SpigotDivision::Reciprocal ? "reciprocal" : "hardware";
+}
+
+std::vector<BenchmarkCase> benchmarkCases(unsigned threads) {
+    std::vector<BenchmarkCase> cases;
+    const PiEngine spigot_engines[] = { PiEngine::Spigot, PiEngine::SpigotLimb4, PiEngine::SpigotLimb9 };
+    for (PiEngine engine : spigot_engines) {
+        for (int kernel = 0; kernel < 3; ++kernel) {
+            BenchmarkCase entry;
+            entry.engine = engine;
+            entry.spigot.threads = threads;
+            entry.spigot.division = (kernel == 1) ? SpigotDivision::Reciprocal : SpigotDivision::Hardware;
+            entry.spigot.simd = (kernel == 2);
+            cases.push_back(entry);
+        }
+    }
+    const PiEngine other_engines[] = { PiEngine::Chudnovsky, PiEngine::Machin, PiEngine::Takano };
+    for (PiEngine engine : other_engines) {
+        BenchmarkCase entry;
+        entry.engine = engine;
+        entry.spigot.threads = threads;
+        cases.push_back(entry);
+    }
+    return cases;
+}
+
+BenchmarkResult runBenchmark(const BenchmarkCase& config, long long digits, int warmup, int repetitions) {
+    if (repetitions < 1) {
+        throw std::invalid_argument("runBenchmark: repetitions must be at least 1");
+    }
+    size_t produced = 0;
+    for (int i = 0; i < warmup; ++i) {
+        produced += calculatePiDigitsString(digits, config.engine, config.spigot).size();
+    }
+
+    std::vector<long long> samples;
+    samples.reserve(repetitions);
+    for (int i = 0; i < repetitions; ++i) {
+        auto start_time = std::chrono::steady_clock::now();
+        produced += calculatePiDigitsString(digits, config.engine, config.spigot).size();
+        auto end_time = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count());
+    }
+    if (produced != static_cast<size_t>(warmup + repetitions) * static_cast<size_t>(digits + 2)) {
+        throw std::logic_error("runBenchmark: engine returned the wrong number of digits");
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchmarkResult result;
+    result.config = config;
+    result.digits = digits;
+    result.warmup = warmup;
+    result.repetitions = repetitions;
+    result.min_ns = samples.front();
+    size_t middle = samples.size() / 2;
+    result.median_ns = (samples.size() % 2 == 1) ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+    size_t p95_rank = (samples.size() * 95 + 99) / 100;
+    result.p95_ns = samples[p95_rank - 1];
+    result.digits_per_second = (result.median_ns > 0) ? digits * 1e9 / static_cast<double>(result.median_ns) : 0.0;
+    return result;
+}
+
+void writeBenchmarkCsv(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << "engine,kernel,threads,digits,warmup,repetitions,min_ns,median_ns,p95_ns,digits_per_second\n";
+    for (const BenchmarkResult& result : results) {
+        bool spigot = isSpigotEngine(result.config.engine);
+        out << piEngineName(result.config.engine) << ','
+            << (spigot ? spigotKernelName(result.config.spigot) : "") << ','
+            << result.config.spigot.threads << ','
+            << result.digits << ',' << result.warmup << ',' << result.repetitions << ','
+            << result.min_ns << ',' << result.median_ns << ',' << result.p95_ns << ','
+            << std::fixed << std::setprecision(1) << result.digits_per_second << '\n';
+    }
+}
+
+void writeBenchmarkJson(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        bool spigot = isSpigotEngine(result.config.engine);
+        out << "  {\"engine\": \"" << piEngineName(result.config.engine) << "\", \"kernel\": ";
+        if (spigot) {
+            out << '"' << spigotKernelName(result.config.spigot) << '"';
+        }
+        else {
+            out << "null";
+        }
+        out << ", \"threads\": " << result.config.spigot.threads
+            << ", \"digits\": " << result.digits
+            << ", \"warmup\": " << result.warmup
+            << ", \"repetitions\": " << result.repetitions
+            << ", \"min_ns\": " << result.min_ns
+            << ", \"median_ns\": " << result.median_ns
+            << ", \"p95_ns\": " << result.p95_ns
+            << ", \"digits_per_second\": " << std::fixed << std::setprecision(1) << result.digits_per_second
+            << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "]\n";
+}
 
-    return 0;
-}
\ No newline at end of file
+}  // namespace pitime
@@ -0,0 +1,697 @@
+/*
+* =======================================================================================
+* PiTime Library Interface
+* =======================================================================================
+*
+* The engines of PiTime as a library(`pitime`, built from PiTime.cpp); the command line
+* program(PiTimeMain.cpp) is one client of it. Everything is in namespace `pitime`.
+* - `DigitEngine` is the abstract engine interface. `makeDigitEngine` creates one of the
+*   decimal engines(spigot, Machin, Chudnovsky) and `makeBbpEngine` the hexadecimal and
+*   binary digit extractor, all configured by `EngineOptions`(threads, memory limit,
+*   spigot kernel). An engine object can be kept and reused for many requests; the
+*   Chudnovsky engine keeps its series, so a later request only splits the new terms.
+* - Digits are delivered in order through a `DigitSink`, or collected into a string.
+* - The free functions(`calculatePiDigitsString`, `streamPiDigits`, ...) are the same
+*   engines without an engine object.
+* - `PiDigitCache`, the verification checks, `DigitWriter` and the benchmark harness are
+*   the building blocks of the command line program, usable on their own.
+* - `SharedPiDigits` answers concurrent requests from one shared expansion, and
+*   `DigitServer` serves it on a socket.
+* - `SplitWorker` splits Chudnovsky term ranges for engines on other machines.
+* Engine objects are not thread-safe: use one per thread, serialise the requests, or
+* share them through `SharedPiDigits`.
+* The big-integer multiply thread count(`setMultiplyThreads`) is process-wide.
+*/
+#ifndef PITIME_H
+#define PITIME_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iosfwd>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pitime {
+
+/*
+* Spigot Options:
+* ---------------
+* Kernel and run options of the spigot engines; the defaults are the plain k = 1 sweep
+* with hardware division on a single thread. A state array larger than a non-zero
+* `memory_budget` is kept in the file `spill_path` and swept from there(see Out-of-Core
+* State in PiTime.cpp).
+*/
+enum class SpigotDivision {
+    Hardware,
+    Reciprocal
+};
+
+const size_t SPIGOT_TILE_AUTO = std::numeric_limits<size_t>::max();
+const char* const SPIGOT_SPILL_DEFAULT = "PiTime.spill";  // in the working directory
+
+class SpigotProfile;
+struct SpigotProgress;
+
+struct SpigotOptions {
+    int limb_digits;
+    SpigotDivision division;
+    unsigned threads;
+    bool simd;
+    std::string checkpoint_path;  // empty: no checkpointing
+    unsigned checkpoint_seconds;  // minimum time between two checkpoints
+    bool resume;                  // continue from `checkpoint_path` instead of starting over
+    size_t tile_elements;         // 0: untiled sweeps, SPIGOT_TILE_AUTO: sized from the cache
+    SpigotProfile* profile;       // null: no instrumentation
+    SpigotProgress* progress;     // null: no progress counters
+    bool shrink_window;           // stop sweeping the tail of `a` once it can no longer matter
+    unsigned long long memory_budget;  // bytes of `a` kept in memory; 0: all of it
+    std::string spill_path;            // where `a` goes beyond the budget; empty: SPIGOT_SPILL_DEFAULT
+
+    SpigotOptions()
+        : limb_digits(1), division(SpigotDivision::Hardware), threads(1), simd(false), checkpoint_seconds(60),
+          resume(false), tile_elements(0), profile(nullptr), progress(nullptr), shrink_window(false),
+          memory_budget(0) {}
+};
+
+bool parseSpigotDivision(const std::string& name, SpigotDivision& division);
+const char* spigotKernelName(const SpigotOptions& options);
+
+/*
+* Instrumentation:
+* ----------------
+* Hardware counters per spigot phase(see PiTime.cpp); pass a `SpigotProfile` in
+* `SpigotOptions::profile` and print it with `writeSpigotProfile`.
+*/
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    CacheMisses,
+    BranchMisses
+};
+
+const int PERF_EVENT_COUNT = 4;
+
+struct PerfReading {
+    uint64_t nanoseconds;
+    uint64_t counts[PERF_EVENT_COUNT];
+};
+
+class PerfCounterGroup {
+public:
+    PerfCounterGroup();
+    ~PerfCounterGroup();
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool available(PerfEvent event) const { return slot[static_cast<int>(event)] >= 0; }
+
+    PerfReading read() const;
+
+private:
+    int leader;
+    std::vector<int> members;
+    int opened;
+    int slot[PERF_EVENT_COUNT];  // position of each event in a group read, -1 if missing
+};
+
+enum class SpigotPhase {
+    Total,
+    Resolve,
+    Assemble
+};
+
+const int SPIGOT_PHASE_COUNT = 3;
+
+class SpigotProfile {
+public:
+    SpigotProfile() { std::memset(totals, 0, sizeof(totals)); }
+
+    const PerfCounterGroup& counters() const { return group; }
+
+    PerfReading read() const { return group.read(); }
+
+    void add(SpigotPhase phase, const PerfReading& start, const PerfReading& end) {
+        PerfReading& total = totals[static_cast<int>(phase)];
+        total.nanoseconds += end.nanoseconds - start.nanoseconds;
+        for (int e = 0; e < PERF_EVENT_COUNT; ++e) {
+            total.counts[e] += end.counts[e] - start.counts[e];
+        }
+    }
+
+    const PerfReading& total(SpigotPhase phase) const { return totals[static_cast<int>(phase)]; }
+
+private:
+    PerfCounterGroup group;
+    PerfReading totals[SPIGOT_PHASE_COUNT];
+};
+
+void writeSpigotProfile(std::ostream& out, const SpigotProfile& profile);
+
+/*
+* Progress Reporting:
+* -------------------
+* A spigot run publishes its position in the `SpigotProgress` of
+* `SpigotOptions::progress`; a `ProgressReporter` prints it from its own thread.
+*/
+struct SpigotProgress {
+    std::atomic<unsigned long long> sweeps_done;
+    std::atomic<unsigned long long> sweeps_total;
+    std::atomic<unsigned long long> len;
+    std::atomic<unsigned long long> digits_done;
+    std::atomic<unsigned long long> digits_total;
+    std::atomic<bool> shrinking;
+
+    SpigotProgress() : sweeps_done(0), sweeps_total(0), len(0), digits_done(0), digits_total(0), shrinking(false) {}
+
+    void begin(unsigned long long sweeps, unsigned long long state_length, unsigned long long digits,
+               bool shrinking_window = false) {
+        len.store(state_length, std::memory_order_relaxed);
+        digits_total.store(digits, std::memory_order_relaxed);
+        shrinking.store(shrinking_window, std::memory_order_relaxed);
+        sweeps_total.store(sweeps, std::memory_order_relaxed);
+    }
+
+    // Element updates performed in the first `sweeps` sweeps.
+    double workBefore(unsigned long long sweeps) const {
+        double done = static_cast<double>(sweeps);
+        double work = done * static_cast<double>(len.load(std::memory_order_relaxed));
+        unsigned long long total = sweeps_total.load(std::memory_order_relaxed);
+        if (shrinking.load(std::memory_order_relaxed) && total > 0) {
+            work *= 1.0 - done / (2.0 * static_cast<double>(total));
+        }
+        return work;
+    }
+};
+
+class ProgressReporter {
+public:
+    ProgressReporter(const SpigotProgress& progress, std::ostream& out, std::chrono::milliseconds interval);
+    ~ProgressReporter() { stop(); }
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    // Prints a last report and ends the line; safe to call more than once.
+    void stop();
+
+private:
+    const SpigotProgress& progress;
+    std::ostream& out;
+    std::chrono::milliseconds interval;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+
+    static std::string formatDuration(double seconds);
+    void run();
+};
+
+/*
+* Digit Sinks:
+* ------------
+* The streaming entry points pass the output, in order, to a `DigitSink` callback as
+* soon as it is confirmed: first "3.", then the decimals in chunks of whatever size the
+* engine confirms at once. Concatenating every chunk gives exactly the string the
+* corresponding `calculatePiDigits...` function returns, so nothing has to be held in
+* memory by the engine itself.
+*/
+typedef std::function<void(const char* digits, size_t count)> DigitSink;
+
+/*
+* Engine selection: `calculatePiDigitsString(n)` keeps running the spigot; pass a
+* `PiEngine` to choose an engine at runtime. Every engine returns the same "3.xxxx"
+* string format.
+*/
+enum class PiEngine {
+    Spigot,
+    SpigotLimb4,
+    SpigotLimb9,
+    Chudnovsky,
+    Machin,
+    Takano
+};
+
+enum class MachinFormula {
+    Machin,
+    Takano
+};
+
+bool parsePiEngine(const std::string& name, PiEngine& engine);
+const char* piEngineName(PiEngine engine);
+// The engines that run the spigot sweep(and take its kernel options).
+bool isSpigotEngine(PiEngine engine);
+
+std::string calculatePiDigitsString(long long n);
+std::string calculatePiDigitsString(long long n, PiEngine engine);
+std::string calculatePiDigitsString(long long n, PiEngine engine, const SpigotOptions& spigot_options);
+void streamPiDigits(long long n, PiEngine engine, const SpigotOptions& spigot_options, const DigitSink& sink);
+
+std::string calculatePiDigitsSpigot(long long n, const SpigotOptions& options);
+void streamPiDigitsSpigot(long long n, const SpigotOptions& options, const DigitSink& sink);
+std::string calculatePiDigitsChudnovsky(long long n);
+// Reuses and extends the series products stored in `series_path`.
+std::string calculatePiDigitsChudnovsky(long long n, const std::string& series_path);
+std::string calculatePiDigitsMachin(long long n, MachinFormula formula = MachinFormula::Machin,
+                                    unsigned threads = 1);
+
+const unsigned long long BBP_MAX_OFFSET = 1ULL << 56;
+
+// `count` hexadecimal(uppercase) or binary digits of pi from position `offset` after the point.
+std::string calculatePiHexDigits(unsigned long long offset, size_t count, unsigned threads);
+std::string calculatePiBinaryDigits(unsigned long long offset, size_t count, unsigned threads);
+
+// Threads of the big-integer multiply outside a task scheduler(process-wide, default 1).
+void setMultiplyThreads(unsigned threads);
+
+/*
+* Engine Interface:
+* -----------------
+* A `DigitEngine` answers `DigitRequest`s: the decimal expansion("3." and `count`
+* decimals, `offset` 0) from the decimal engines, or `count` hexadecimal or binary
+* digits from position `offset` from the BBP engine. `supports` tells which radix an
+* engine serves. `memoryEstimate` is the approximate peak memory of a request; with
+* `EngineOptions::memory_limit` set, a request whose estimate exceeds it is refused with
+* std::length_error before anything is allocated. Unsupported requests throw
+* std::invalid_argument. Decimal requests of up to `PI_TABLE_DIGITS` decimals are
+* answered from a built-in table unless `EngineOptions::use_table` is cleared.
+*/
+const unsigned long long PI_TABLE_DIGITS = 1000;
+
+enum class DigitRadix {
+    Decimal,
+    Hexadecimal,
+    Binary
+};
+
+struct DigitRequest {
+    DigitRadix radix;
+    unsigned long long offset;  // first digit after the point; 0 for decimal requests
+    unsigned long long count;
+
+    DigitRequest(DigitRadix radix, unsigned long long offset, unsigned long long count)
+        : radix(radix), offset(offset), count(count) {}
+
+    static DigitRequest decimals(unsigned long long count) { return DigitRequest(DigitRadix::Decimal, 0, count); }
+};
+
+struct EngineOptions {
+    unsigned threads;                 // worker threads of one request(spigot pipeline, series, BBP)
+    unsigned long long memory_limit;  // bytes a request may need(by `memoryEstimate`); 0: no limit
+    SpigotOptions spigot;             // kernel of the spigot engines; `threads` overrides spigot.threads
+    bool use_table;                   // serve short decimal requests from the table; false: always compute
+    std::vector<std::string> nodes;   // Chudnovsky: `SplitWorker` addresses to split on; empty: locally
+
+    EngineOptions() : threads(1), memory_limit(0), use_table(true) {}
+};
+
+class DigitEngine {
+public:
+    virtual ~DigitEngine() {}
+
+    DigitEngine(const DigitEngine&) = delete;
+    DigitEngine& operator=(const DigitEngine&) = delete;
+
+    virtual const char* name() const = 0;
+    virtual bool supports(DigitRadix radix) const = 0;
+    virtual unsigned long long memoryEstimate(const DigitRequest& request) const = 0;
+
+    // Delivers the digits of `request` to `sink`, in order.
+    void stream(const DigitRequest& request, const DigitSink& sink);
+    std::string digits(const DigitRequest& request);
+
+    const EngineOptions& options() const { return settings; }
+
+protected:
+    explicit DigitEngine(const EngineOptions& options) : settings(options) {}
+
+    virtual void run(const DigitRequest& request, const DigitSink& sink) = 0;
+
+    EngineOptions settings;
+};
+
+std::unique_ptr<DigitEngine> makeDigitEngine(PiEngine engine, const EngineOptions& options = EngineOptions());
+std::unique_ptr<DigitEngine> makeBbpEngine(const EngineOptions& options = EngineOptions());
+
+/*
+* Digit Cache:
+* ------------
+* The longest expansion computed so far, kept in a memory-mapped file; views point
+* straight into the mapping and stay valid until the next `store`.
+*/
+struct PiDigitsView {
+    const char* data;  // "3.xxxx", not NUL-terminated
+    size_t size;
+};
+
+class MappedFile;
+
+class PiDigitCache {
+public:
+    explicit PiDigitCache(const std::string& path);
+    ~PiDigitCache();
+
+    PiDigitCache(const PiDigitCache&) = delete;
+    PiDigitCache& operator=(const PiDigitCache&) = delete;
+
+    // Decimals available without computing, or -1 for an empty cache.
+    long long digitCount() const { return cached_digits; }
+
+    // "3." plus the first n decimals; requires n <= digitCount().
+    PiDigitsView view(long long n) const;
+
+    void store(const std::string& digits);
+
+private:
+    std::string path;
+    std::unique_ptr<MappedFile> file;
+    long long cached_digits;
+
+    void load();
+};
+
+// n decimals from the cache, computing(and caching) them with `compute` on a miss.
+PiDigitsView cachedPiDigits(PiDigitCache& cache, long long n, const std::function<std::string(long long)>& compute);
+PiDigitsView cachedPiDigits(PiDigitCache& cache, long long n, PiEngine engine, const SpigotOptions& options);
+
+/*
+* Verification:
+* -------------
+* A digit string against a reference(a second engine or a known-good file), and the
+* BBP spot-check of a decimal result. Positions count from the "3" at index 0.
+*/
+struct DigitMismatch {
+    unsigned long long index;  // position in the "3.xxxx" string
+    char got;
+    char expected;             // 0 when the reference ended before `index`
+};
+
+// Compares a digit string with its reference chunk by chunk, in order.
+class DigitComparator {
+public:
+    DigitComparator() : compared(0), mismatch_count(0), reference_short(false) {}
+
+    void compare(const char* got, const char* expected, size_t count);
+    // `count` produced characters for which the reference has no counterpart.
+    void referenceEnded(const char* got, size_t count);
+
+    bool ok() const { return mismatch_count == 0; }
+    unsigned long long comparedCount() const { return compared; }
+    unsigned long long mismatchCount() const { return mismatch_count; }
+    const std::vector<DigitMismatch>& reported() const { return mismatches; }
+
+private:
+    unsigned long long compared;
+    unsigned long long mismatch_count;
+    bool reference_short;
+    std::vector<DigitMismatch> mismatches;  // the first VERIFY_MAX_REPORTED
+
+    void record(unsigned long long index, char got, char expected);
+};
+
+// Feeds streamed output and the matching bytes of a reference file to a comparator.
+class DigitFileVerifier {
+public:
+    explicit DigitFileVerifier(const std::string& path);
+
+    void feed(const char* digits, size_t count);
+
+    const DigitComparator& result() const { return comparator; }
+
+private:
+    std::ifstream in;
+    std::vector<char> chunk;
+    DigitComparator comparator;
+};
+
+void writeVerificationReport(std::ostream& out, const std::string& against, const DigitComparator& comparator);
+
+struct BbpVerification {
+    bool checked;              // false when the output is too short for a spot-check
+    bool ok;
+    long long hex_position;    // the hex digits compared at full length
+    long long first_bad_from;  // on failure, the first wrong decimal lies in
+    long long first_bad_to;    // (first_bad_from, first_bad_to]
+};
+
+BbpVerification verifyPiDigitsBbp(const std::string& digits, unsigned threads);
+void writeBbpVerificationReport(std::ostream& out, const BbpVerification& result);
+
+/*
+* Digit Output:
+* -------------
+* `DigitWriter` writes a run's output to standard output or a file with large
+* write/writev calls, optionally laid out in groups and lines(`DigitLayout`).
+*/
+struct DigitLayout {
+    size_t group;  // decimals per space-separated group; 0: no groups
+    size_t line;   // decimals per line; 0: a single line
+
+    DigitLayout() : group(0), line(0) {}
+
+    bool plain() const { return group == 0 && line == 0; }
+};
+
+class DigitWriter {
+public:
+    // Standard output when `path` is empty.
+    DigitWriter(const std::string& path, const DigitLayout& layout);
+    ~DigitWriter();
+
+    DigitWriter(const DigitWriter&) = delete;
+    DigitWriter& operator=(const DigitWriter&) = delete;
+
+    // The next `count` characters of the output("3." first with a layout).
+    void write(const char* data, size_t count);
+    void flush();
+    // Ends the output with a newline and writes out everything staged.
+    void finish();
+
+private:
+    std::string name;
+    DigitLayout layout;
+    std::vector<char> buffer;
+    size_t used;
+    unsigned long long received;
+    std::chrono::steady_clock::time_point last_write;
+#ifdef _WIN32
+    std::FILE* file;
+#else
+    int fd;
+#endif
+
+    void writeFormatted(const char* data, size_t count);
+    void writeOut(const char* data, size_t count);
+};
+
+/*
+* Digit Server:
+* -------------
+* `SharedPiDigits` answers concurrent decimal requests from one shared expansion: a
+* request is served from the digits already known, and requests beyond them are
+* coalesced onto a single computation sized to the largest N waiting. Every request
+* receives its prefix as the computation confirms it. `DigitServer` serves it to
+* clients over a Unix or TCP socket(see PiTime.cpp for the protocol), accepting them
+* with a `SocketAcceptor`.
+*/
+const long long SHARED_DEFAULT_MAX_DIGITS = 100000000;
+
+class SharedPiDigits {
+public:
+    // The computations run on a thread of their own with `makeDigitEngine(engine, options)`.
+    // Requests for more than `max_digits` decimals are refused.
+    SharedPiDigits(PiEngine engine, const EngineOptions& options, long long max_digits = SHARED_DEFAULT_MAX_DIGITS);
+    // Stops, then waits for the computation thread, which ends at the engine's next
+    // delivery.
+    ~SharedPiDigits();
+
+    SharedPiDigits(const SharedPiDigits&) = delete;
+    SharedPiDigits& operator=(const SharedPiDigits&) = delete;
+
+    // Passes "3." and the first n decimals to `sink`, in order, as they become known;
+    // returns when all are delivered. A request over `max_digits` or the engine's memory
+    // limit throws std::length_error up front, one beyond any engine's range
+    // std::invalid_argument; std::runtime_error reports a computation that failed.
+    void request(long long n, const DigitSink& sink);
+
+    // Decimals available without computing: -1 before the first computation, or the
+    // table's PI_TABLE_DIGITS with EngineOptions::use_table.
+    long long digitCount() const;
+
+    // Fails every waiting and later request that needs more than is available and ends
+    // a computation in flight at its next publication. Callable from any thread.
+    void stop();
+
+private:
+    std::unique_ptr<DigitEngine> engine;
+    long long max_digits;
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable digits_ready;
+    std::shared_ptr<std::vector<char>> buffer;  // the expansion; replaced, not resized, to grow
+    size_t available;                           // characters of `buffer` that are final
+    long long wanted;                           // largest n requested
+    long long target;                           // n of the latest computation
+    bool running;
+    unsigned long long started_runs;
+    unsigned long long failed_run;              // 0: none failed
+    std::string failure;
+    bool stopping;
+    std::thread worker;
+
+    void compute();
+};
+
+// The accept loop of `DigitServer` and `SplitWorker`. At most `max_connections` are
+// served at once, each by a thread of its own; beyond that, clients wait in the listen
+// backlog. Running out of descriptors, memory or threads is waited out, not fatal.
+class SocketAcceptor {
+public:
+    // `address` is a Unix socket path(anything containing '/') or a TCP "[HOST:]PORT".
+    SocketAcceptor(const std::string& address, size_t max_connections);
+    // Stops; the socket file of a Unix address is removed again.
+    ~SocketAcceptor();
+
+    SocketAcceptor(const SocketAcceptor&) = delete;
+    SocketAcceptor& operator=(const SocketAcceptor&) = delete;
+
+    // Calls `serve` on the thread of every accepted connection; the acceptor closes the
+    // connection when it returns. Returns after `stop`; throws when accepting fails for
+    // good.
+    void run(const std::function<void(int connection)>& serve);
+
+    // Makes `run` return, shuts every connection down and joins its thread; a `serve`
+    // blocked elsewhere than on its connection must be woken by its owner first.
+    // Callable from any thread.
+    void stop();
+
+    const std::string& address() const { return listen_address; }
+
+private:
+    struct Connection {
+        int fd;  // -1 once closed
+        bool done;
+        std::thread thread;
+    };
+
+    std::string listen_address;
+    std::string unix_path;
+    int listener;
+    int wake[2];  // a pipe that interrupts the wait for the next connection
+    size_t max_connections;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<unsigned long long, Connection> connections;  // not yet joined
+    unsigned long long next_id;
+    size_t running;
+    bool stopping;
+
+    void serveConnection(unsigned long long id, int connection, std::function<void(int)> serve);
+    void reap();
+};
+
+class DigitServer {
+public:
+    // `address` as for `SocketAcceptor`.
+    DigitServer(const std::string& address, SharedPiDigits& digits);
+    // Stops, so that no connection outlives the server or `digits`.
+    ~DigitServer();
+
+    DigitServer(const DigitServer&) = delete;
+    DigitServer& operator=(const DigitServer&) = delete;
+
+    // Accepts connections and serves each on a thread of its own; returns after `stop`
+    // and throws when accepting fails for good.
+    void run();
+
+    // Stops `digits`(`SharedPiDigits::stop`), which fails the requests in flight, and
+    // the acceptor. Callable from any thread.
+    void stop();
+
+private:
+    SharedPiDigits& digits;
+    SocketAcceptor acceptor;
+
+    void serve(int connection);
+};
+
+/*
+* Distributed Binary Splitting:
+* -----------------------------
+* A `SplitWorker` computes the Chudnovsky products of the term ranges that a
+* coordinator sends it: a Chudnovsky engine whose `EngineOptions::nodes` lists the
+* workers' addresses splits the new terms of every request on them and merges the
+* results itself. A worker checks that the coordinator shares its byte order and limb
+* width and splits one range at a time.
+*/
+class SplitWorker {
+public:
+    // `address` as for `SocketAcceptor`; every range is split on `threads` workers.
+    SplitWorker(const std::string& address, unsigned threads);
+    // Stops; a split in progress cannot be interrupted and is waited for.
+    ~SplitWorker();
+
+    SplitWorker(const SplitWorker&) = delete;
+    SplitWorker& operator=(const SplitWorker&) = delete;
+
+    // Accepts coordinators and serves each on a thread of its own; returns after `stop`
+    // and throws when accepting fails for good.
+    void run();
+
+    // Refuses the waiting requests and stops the acceptor. Callable from any thread.
+    void stop();
+
+private:
+    unsigned threads;
+    std::mutex mutex;
+    std::condition_variable slot_free;
+    unsigned active_splits;
+    bool stopping;
+    SocketAcceptor acceptor;  // last: its threads use the members above
+
+    void serve(int connection);
+};
+
+/*
+* Benchmark Harness:
+* ------------------
+* Timings of engine/kernel combinations, reported as CSV or JSON.
+*/
+struct BenchmarkCase {
+    PiEngine engine;
+    SpigotOptions spigot;
+};
+
+struct BenchmarkResult {
+    BenchmarkCase config;
+    long long digits;
+    int warmup;
+    int repetitions;
+    long long min_ns;
+    long long median_ns;
+    long long p95_ns;
+    double digits_per_second;
+};
+
+// Every engine, and for the spigot engines every sweep kernel, at the given thread count.
+std::vector<BenchmarkCase> benchmarkCases(unsigned threads);
+BenchmarkResult runBenchmark(const BenchmarkCase& config, long long digits, int warmup, int repetitions);
+void writeBenchmarkCsv(std::ostream& out, const std::vector<BenchmarkResult>& results);
+void writeBenchmarkJson(std::ostream& out, const std::vector<BenchmarkResult>& results);
+
+}  // namespace pitime
+
+#endif
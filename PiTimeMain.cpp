@@ -0,0 +1,701 @@
+/*
+* =======================================================================================
+* PiTime Command Line Program
+* =======================================================================================
+*
+* The `PiTime` executable: it parses the command line, runs the chosen engine of the
+* `pitime` library(PiTime.h) and writes the digits, the timing and any verification or
+* profiling report. Everything it does is available to other programs through the
+* library.
+*/
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PiTime.h"
+
+using namespace pitime;
+
+/*
+* Command Line:
+* -------------
+*     PiTime [-n DIGITS] [-e ENGINE] [-k KERNEL] [-t THREADS] [-o FILE]
+*     PiTime --bench N1,N2,... [--warmup W] [--repeat R] [--format csv|json] [-e ENGINE] [-k KERNEL]
+* `parseCommandLine` fills `CommandLineOptions` and reports the first problem in
+* `error`; `main` prints usage on any error. `--threads 0` uses every hardware thread.
+* In benchmark mode `-e` and `-k` narrow the sweep instead of choosing a single run.
+* `--checkpoint FILE` snapshots a spigot run every `--checkpoint-every` seconds;
+* `--resume FILE` continues it when started again with the same -n/-e/-k options.
+* `--progress` reports digits, digit rate and ETA of a spigot run on stderr every second.
+* `--profile` prints hardware counters and the phase split of a spigot run to stderr.
+* `--tile auto|T` runs the single-threaded sweep in cache-sized tiles of T positions.
+* `--shrink-window` stops sweeping the tail of the spigot state once it cannot change
+* the remaining digits.
+* `--hex POS`/`--binary POS` print N hexadecimal/binary digits from position POS with
+* the BBP engine instead of the decimal expansion.
+* `--series FILE` keeps the Chudnovsky binary-splitting products in FILE so a later
+* request for more digits only computes the new terms.
+* `--verify bbp|ENGINE` and `--verify-file FILE` check the decimal result(see
+* Verification) and report on stderr; a failed check makes the exit status 2.
+* `--cache FILE` answers from the digit cache in FILE and stores new results there.
+* `--group G` and `--line L` lay the decimals out in groups and lines(see Digit Output).
+* `--memory-limit MB` refuses a run whose engine estimates more memory than MB MiB.
+* `--memory-budget MB` keeps a spigot state array larger than MB MiB in the file given
+* by `--spill FILE`(default PiTime.spill in the working directory) and sweeps it there.
+* `--serve ADDRESS` answers digit requests on a Unix socket path or TCP [HOST:]PORT
+* with the chosen engine instead of running once(see Digit Server), up to
+* `--max-digits` decimals per request.
+* `--worker ADDRESS` runs a split worker there instead, and `--nodes A1,A2,...` has the
+* Chudnovsky engine split its terms on such workers(see Distributed Binary Splitting).
+*/
+struct CommandLineOptions {
+    long long digits;
+    PiEngine engine;
+    SpigotOptions spigot;
+    std::string output_path;
+    DigitLayout layout;
+    std::string series_path;
+    std::string cache_path;
+    std::string verify_against;  // "bbp" or an engine name; empty: no cross-check
+    bool verify_engine_given;
+    PiEngine verify_engine;
+    std::string verify_path;     // known-good digit file; empty: none
+    std::string serve_address;   // empty: a single run
+    long long serve_max_digits;
+    std::string worker_address;  // empty: not a split worker
+    std::vector<std::string> nodes;  // split workers of the chudnovsky engine
+    unsigned long long memory_limit;  // bytes; 0: no limit
+    long long hex_offset;     // -1: decimal output
+    long long binary_offset;  // -1: decimal output
+    bool show_help;
+    bool profile;
+    bool progress;
+    bool engine_given;
+    bool kernel_given;
+    bool serve_max_given;
+    std::vector<long long> bench_digits;
+    int bench_warmup;
+    int bench_repetitions;
+    std::string bench_format;
+
+    CommandLineOptions()
+        : digits(10000), engine(PiEngine::Spigot), verify_engine_given(false), verify_engine(PiEngine::Spigot),
+          serve_max_digits(SHARED_DEFAULT_MAX_DIGITS), memory_limit(0), hex_offset(-1), binary_offset(-1), show_help(false),
+          profile(false), progress(false), engine_given(false), kernel_given(false), serve_max_given(false),
+          bench_warmup(1), bench_repetitions(5), bench_format("csv") {}
+};
+
+bool parseNonNegative(const std::string& text, long long& value) {
+    if (text.empty() || text[0] == '-') {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Comma separated list of addresses, none of them empty.
+bool parseAddressList(const std::string& text, std::vector<std::string>& values) {
+    values.clear();
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        std::string value = text.substr(start, comma - start);
+        if (value.empty()) {
+            return false;
+        }
+        values.push_back(value);
+        if (comma == std::string::npos) {
+            return true;
+        }
+        start = comma + 1;
+    }
+}
+
+// Comma separated list of digit counts, e.g. "1000,10000,100000".
+bool parseDigitList(const std::string& text, std::vector<long long>& values) {
+    values.clear();
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        long long value = 0;
+        if (!parseNonNegative(text.substr(start, comma - start), value)) {
+            return false;
+        }
+        values.push_back(value);
+        if (comma == std::string::npos) {
+            return true;
+        }
+        start = comma + 1;
+    }
+}
+
+void printUsage(std::ostream& out) {
+    out << "Usage: PiTime [options]\n"
+        << "  -n, --digits N      number of decimals after \"3.\" (default 10000)\n"
+        << "  -e, --engine NAME   spigot, spigot4, spigot9, chudnovsky, machin or takano (default spigot)\n"
+        << "  -k, --kernel NAME   spigot sweep kernel: hardware, reciprocal or simd (default hardware)\n"
+        << "  -t, --threads T     worker threads (spigot pipeline, chudnovsky, machin series), 0 = all (default 1)\n"
+        << "  -o, --output FILE   write the digits (or benchmark report) to FILE instead of standard output\n"
+        << "  --group G           separate the decimals into groups of G digits\n"
+        << "  --line L            print L decimals per line\n"
+        << "  --progress          print digits done, digits/s and an ETA of a spigot run every second\n"
+        << "  --profile           report cycles, instructions, cache/branch misses per spigot phase\n"
+        << "  --tile auto|T       cache-blocked spigot sweep with tiles of T positions (auto: from L2 size)\n"
+        << "  --shrink-window     skip the converged tail of the spigot state (about half the work)\n"
+        << "  --checkpoint FILE   periodically save the spigot state to FILE\n"
+        << "  --checkpoint-every S  seconds between checkpoints (default 60)\n"
+        << "  --resume FILE       continue the spigot run saved in FILE\n"
+        << "  --hex POS           print N hex digits of pi from hex position POS (BBP engine)\n"
+        << "  --binary POS        print N binary digits of pi from bit position POS (BBP engine)\n"
+        << "  --cache FILE        serve the digits from the cache FILE, computing and storing misses\n"
+        << "  --series FILE       chudnovsky: reuse and extend the series products stored in FILE\n"
+        << "  --verify bbp|ENGINE cross-check the digits with a BBP hex spot-check or a second engine\n"
+        << "  --verify-file FILE  compare the digits with the known-good digit file FILE\n"
+        << "  --memory-limit MB   refuse runs estimated to need more than MB MiB\n"
+        << "  --memory-budget MB  spigot: keep a state array beyond MB MiB on disk\n"
+        << "  --spill FILE        file for the spilled spigot state (default PiTime.spill)\n"
+        << "  --serve ADDRESS     serve digit requests on a Unix socket path or TCP [HOST:]PORT\n"
+        << "  --max-digits N      --serve: refuse requests for more than N decimals (default 100000000)\n"
+        << "  --worker ADDRESS    split chudnovsky term ranges for coordinators connecting to ADDRESS\n"
+        << "  --nodes A1,A2,...   chudnovsky: split the series on the workers at these addresses\n"
+        << "  -h, --help          show this message\n"
+        << "Benchmark mode:\n"
+        << "  --bench N1,N2,...   time every engine and kernel at each digit count\n"
+        << "  --warmup W          untimed runs before measuring (default 1)\n"
+        << "  --repeat R          timed runs per measurement (default 5)\n"
+        << "  --format FORMAT     report format: csv or json (default csv)\n";
+}
+
+bool parseCommandLine(int argc, char* argv[], CommandLineOptions& options, std::string& error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            options.show_help = true;
+            continue;
+        }
+        if (arg == "--profile" || arg == "--progress") {
+            (arg == "--profile" ? options.profile : options.progress) = true;
+            continue;
+        }
+        if (arg == "--shrink-window") {
+            options.spigot.shrink_window = true;
+            continue;
+        }
+        bool takes_value = arg == "-n" || arg == "--digits" || arg == "-e" || arg == "--engine" ||
+                           arg == "-k" || arg == "--kernel" || arg == "-t" || arg == "--threads" ||
+                           arg == "-o" || arg == "--output" || arg == "--bench" || arg == "--warmup" ||
+                           arg == "--repeat" || arg == "--format" || arg == "--checkpoint" ||
+                           arg == "--checkpoint-every" || arg == "--resume" || arg == "--series" ||
+                           arg == "--hex" || arg == "--binary" || arg == "--cache" || arg == "--tile" ||
+                           arg == "--verify" || arg == "--verify-file" || arg == "--group" || arg == "--line" ||
+                           arg == "--memory-limit" || arg == "--serve" || arg == "--memory-budget" ||
+                           arg == "--spill" || arg == "--worker" || arg == "--nodes" ||
+                           arg == "--max-digits";
+        if (!takes_value) {
+            error = "unknown option '" + arg + "'";
+            return false;
+        }
+        if (i + 1 >= argc) {
+            error = "missing value for '" + arg + "'";
+            return false;
+        }
+        std::string value = argv[++i];
+        long long number = 0;
+        if (arg == "-n" || arg == "--digits") {
+            if (!parseNonNegative(value, number)) {
+                error = "invalid digit count '" + value + "'";
+                return false;
+            }
+            options.digits = number;
+        }
+        else if (arg == "-e" || arg == "--engine") {
+            if (!parsePiEngine(value, options.engine)) {
+                error = "unknown engine '" + value + "'";
+                return false;
+            }
+            options.engine_given = true;
+        }
+        else if (arg == "-k" || arg == "--kernel") {
+            if (value == "simd") {
+                options.spigot.simd = true;
+            }
+            else if (!parseSpigotDivision(value, options.spigot.division)) {
+                error = "unknown kernel '" + value + "'";
+                return false;
+            }
+            options.kernel_given = true;
+        }
+        else if (arg == "-t" || arg == "--threads") {
+            if (!parseNonNegative(value, number) || number > 65536) {
+                error = "invalid thread count '" + value + "'";
+                return false;
+            }
+            options.spigot.threads = (number == 0) ? std::max(1u, std::thread::hardware_concurrency())
+                                                   : static_cast<unsigned>(number);
+        }
+        else if (arg == "--bench") {
+            if (!parseDigitList(value, options.bench_digits)) {
+                error = "invalid digit list '" + value + "'";
+                return false;
+            }
+        }
+        else if (arg == "--warmup") {
+            if (!parseNonNegative(value, number) || number > 1000000) {
+                error = "invalid warmup count '" + value + "'";
+                return false;
+            }
+            options.bench_warmup = static_cast<int>(number);
+        }
+        else if (arg == "--repeat") {
+            if (!parseNonNegative(value, number) || number < 1 || number > 1000000) {
+                error = "invalid repetition count '" + value + "'";
+                return false;
+            }
+            options.bench_repetitions = static_cast<int>(number);
+        }
+        else if (arg == "--format") {
+            if (value != "csv" && value != "json") {
+                error = "unknown report format '" + value + "'";
+                return false;
+            }
+            options.bench_format = value;
+        }
+        else if (arg == "--checkpoint" || arg == "--resume") {
+            options.spigot.checkpoint_path = value;
+            options.spigot.resume = (arg == "--resume");
+        }
+        else if (arg == "--hex" || arg == "--binary") {
+            if (!parseNonNegative(value, number) || static_cast<unsigned long long>(number) > BBP_MAX_OFFSET) {
+                error = "invalid digit position '" + value + "'";
+                return false;
+            }
+            (arg == "--hex" ? options.hex_offset : options.binary_offset) = number;
+        }
+        else if (arg == "--tile") {
+            if (value == "auto") {
+                options.spigot.tile_elements = SPIGOT_TILE_AUTO;
+            }
+            else if (parseNonNegative(value, number) && number > 0) {
+                options.spigot.tile_elements = static_cast<size_t>(number);
+            }
+            else {
+                error = "invalid tile size '" + value + "'";
+                return false;
+            }
+        }
+        else if (arg == "--group" || arg == "--line") {
+            if (!parseNonNegative(value, number) || number < 1) {
+                error = "invalid " + arg.substr(2) + " length '" + value + "'";
+                return false;
+            }
+            (arg == "--group" ? options.layout.group : options.layout.line) = static_cast<size_t>(number);
+        }
+        else if (arg == "--memory-limit") {
+            if (!parseNonNegative(value, number) || number < 1 || number > (1LL << 40)) {
+                error = "invalid memory limit '" + value + "'";
+                return false;
+            }
+            options.memory_limit = static_cast<unsigned long long>(number) << 20;
+        }
+        else if (arg == "--memory-budget") {
+            if (!parseNonNegative(value, number) || number < 1 || number > (1LL << 40)) {
+                error = "invalid memory budget '" + value + "'";
+                return false;
+            }
+            options.spigot.memory_budget = static_cast<unsigned long long>(number) << 20;
+        }
+        else if (arg == "--spill") {
+            options.spigot.spill_path = value;
+        }
+        else if (arg == "--cache") {
+            options.cache_path = value;
+        }
+        else if (arg == "--verify") {
+            if (value != "bbp") {
+                if (!parsePiEngine(value, options.verify_engine)) {
+                    error = "--verify takes bbp or an engine name, not '" + value + "'";
+                    return false;
+                }
+                options.verify_engine_given = true;
+            }
+            options.verify_against = value;
+        }
+        else if (arg == "--verify-file") {
+            options.verify_path = value;
+        }
+        else if (arg == "--series") {
+            options.series_path = value;
+        }
+        else if (arg == "--serve") {
+            options.serve_address = value;
+        }
+        else if (arg == "--max-digits") {
+            if (!parseNonNegative(value, number)) {
+                error = "invalid maximum digit count '" + value + "'";
+                return false;
+            }
+            options.serve_max_digits = number;
+            options.serve_max_given = true;
+        }
+        else if (arg == "--worker") {
+            options.worker_address = value;
+        }
+        else if (arg == "--nodes") {
+            if (!parseAddressList(value, options.nodes)) {
+                error = "invalid node list '" + value + "'";
+                return false;
+            }
+        }
+        else if (arg == "--checkpoint-every") {
+            if (!parseNonNegative(value, number) || number > 1000000000) {
+                error = "invalid checkpoint interval '" + value + "'";
+                return false;
+            }
+            options.spigot.checkpoint_seconds = static_cast<unsigned>(number);
+        }
+        else {
+            options.output_path = value;
+        }
+    }
+    if (!options.serve_address.empty() &&
+        (options.hex_offset >= 0 || options.binary_offset >= 0 || !options.bench_digits.empty() ||
+         !options.cache_path.empty() || !options.series_path.empty() || !options.verify_against.empty() ||
+         !options.verify_path.empty() || !options.spigot.checkpoint_path.empty() || options.profile ||
+         options.progress || !options.output_path.empty() || !options.layout.plain())) {
+        error = "--serve takes only the engine, kernel, thread and memory options";
+        return false;
+    }
+    if (!options.worker_address.empty() &&
+        (!options.serve_address.empty() || !options.nodes.empty() || options.hex_offset >= 0 ||
+         options.binary_offset >= 0 || !options.bench_digits.empty() || !options.cache_path.empty() ||
+         !options.series_path.empty() || !options.verify_against.empty() || !options.verify_path.empty() ||
+         !options.spigot.checkpoint_path.empty() || options.profile || options.progress ||
+         !options.output_path.empty() || !options.layout.plain() || options.memory_limit != 0 ||
+         options.spigot.memory_budget != 0 || !options.spigot.spill_path.empty() || options.engine_given ||
+         options.kernel_given)) {
+        error = "--worker takes only the thread option";
+        return false;
+    }
+    if (!options.nodes.empty() &&
+        (options.engine != PiEngine::Chudnovsky || options.hex_offset >= 0 || options.binary_offset >= 0 ||
+         !options.bench_digits.empty())) {
+        error = "--nodes needs the chudnovsky engine";
+        return false;
+    }
+    if (!options.nodes.empty() && !options.series_path.empty()) {
+        error = "--nodes cannot be combined with --series";
+        return false;
+    }
+    if (options.serve_max_given && options.serve_address.empty()) {
+        error = "--max-digits applies to --serve";
+        return false;
+    }
+    if (!options.spigot.checkpoint_path.empty() && !isSpigotEngine(options.engine)) {
+        error = "checkpointing is only available for the spigot engines";
+        return false;
+    }
+    if ((options.spigot.memory_budget != 0 || !options.spigot.spill_path.empty()) &&
+        (!isSpigotEngine(options.engine) || options.hex_offset >= 0 || options.binary_offset >= 0)) {
+        error = "--memory-budget and --spill apply to the spigot engines";
+        return false;
+    }
+    if (!options.series_path.empty() && options.engine != PiEngine::Chudnovsky) {
+        error = "--series needs the chudnovsky engine";
+        return false;
+    }
+    if (options.profile && (!isSpigotEngine(options.engine) || options.hex_offset >= 0 ||
+                            options.binary_offset >= 0 || !options.bench_digits.empty())) {
+        error = "--profile instruments single spigot runs only";
+        return false;
+    }
+    if (options.progress && (!isSpigotEngine(options.engine) || options.hex_offset >= 0 ||
+                             options.binary_offset >= 0 || !options.bench_digits.empty())) {
+        error = "--progress is available for single spigot runs only";
+        return false;
+    }
+    if (!options.cache_path.empty() && (options.hex_offset >= 0 || options.binary_offset >= 0)) {
+        error = "--cache only holds decimal digits";
+        return false;
+    }
+    if ((!options.verify_against.empty() || !options.verify_path.empty()) &&
+        (options.hex_offset >= 0 || options.binary_offset >= 0 || !options.bench_digits.empty())) {
+        error = "--verify and --verify-file check single decimal runs only";
+        return false;
+    }
+    if (!options.layout.plain() &&
+        (options.hex_offset >= 0 || options.binary_offset >= 0 || !options.bench_digits.empty())) {
+        error = "--group and --line format decimal output only";
+        return false;
+    }
+    return true;
+}
+
+int runBenchmarkMode(const CommandLineOptions& options, std::ostream& output) {
+    std::vector<BenchmarkResult> results;
+    for (const BenchmarkCase& config : benchmarkCases(options.spigot.threads)) {
+        if (options.engine_given && config.engine != options.engine) {
+            continue;
+        }
+        if (options.kernel_given && isSpigotEngine(config.engine) &&
+            std::string(spigotKernelName(config.spigot)) != spigotKernelName(options.spigot)) {
+            continue;
+        }
+        for (long long digits : options.bench_digits) {
+            std::cerr << "Benchmarking " << piEngineName(config.engine);
+            if (isSpigotEngine(config.engine)) {
+                std::cerr << '/' << spigotKernelName(config.spigot);
+            }
+            std::cerr << " at " << digits << " digits..." << std::endl;
+            results.push_back(runBenchmark(config, digits, options.bench_warmup, options.bench_repetitions));
+        }
+    }
+    if (options.bench_format == "json") {
+        writeBenchmarkJson(output, results);
+    }
+    else {
+        writeBenchmarkCsv(output, results);
+    }
+    return 0;
+}
+
+// Splits term ranges for coordinators until the listening socket fails.
+int runWorkerMode(const CommandLineOptions& options) {
+    try {
+        SplitWorker worker(options.worker_address, options.spigot.threads);
+        std::cerr << "PiTime: splitting chudnovsky terms on '" << options.worker_address << "'" << std::endl;
+        worker.run();
+    }
+    catch (const std::exception& failure) {
+        std::cerr << "PiTime: " << failure.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Serves digit requests until the listening socket fails.
+int runServerMode(const CommandLineOptions& options, const EngineOptions& engine_options) {
+    try {
+        SharedPiDigits digits(options.engine, engine_options, options.serve_max_digits);
+        DigitServer server(options.serve_address, digits);
+        std::cerr << "PiTime: serving " << piEngineName(options.engine) << " digits on '" << options.serve_address
+                  << "'" << std::endl;
+        server.run();
+    }
+    catch (const std::exception& failure) {
+        std::cerr << "PiTime: " << failure.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    CommandLineOptions options;
+    std::string error;
+    if (!parseCommandLine(argc, argv, options, error)) {
+        std::cerr << "PiTime: " << error << std::endl;
+        printUsage(std::cerr);
+        return 1;
+    }
+    if (options.show_help) {
+        printUsage(std::cout);
+        return 0;
+    }
+
+    EngineOptions engine_options;
+    engine_options.threads = options.spigot.threads;
+    engine_options.memory_limit = options.memory_limit;
+    engine_options.spigot = options.spigot;
+    engine_options.nodes = options.nodes;
+    // The table answers the server's short requests. A single run reports its time, so
+    // it always computes.
+    engine_options.use_table = !options.serve_address.empty();
+    if (!options.worker_address.empty()) {
+        setMultiplyThreads(options.spigot.threads);
+        return runWorkerMode(options);
+    }
+    if (!options.serve_address.empty()) {
+        setMultiplyThreads(options.spigot.threads);
+        return runServerMode(options, engine_options);
+    }
+
+    std::unique_ptr<DigitWriter> output;
+    try {
+        output.reset(new DigitWriter(options.output_path, options.layout));
+    }
+    catch (const std::exception& failure) {
+        std::cerr << "PiTime: " << failure.what() << std::endl;
+        return 1;
+    }
+
+    setMultiplyThreads(options.spigot.threads);
+    if (!options.bench_digits.empty()) {
+        std::ostringstream report;
+        int status = runBenchmarkMode(options, report);
+        try {
+            std::string text = report.str();
+            output->write(text.data(), text.size());
+            output->flush();
+        }
+        catch (const std::exception& failure) {
+            std::cerr << "PiTime: " << failure.what() << std::endl;
+            return 1;
+        }
+        return status;
+    }
+
+    SpigotProfile profile;
+    if (options.profile) {
+        options.spigot.profile = &profile;
+    }
+    SpigotProgress progress;
+    std::unique_ptr<ProgressReporter> reporter;
+    if (options.progress) {
+        options.spigot.progress = &progress;
+        reporter.reset(new ProgressReporter(progress, std::cerr, std::chrono::milliseconds(1000)));
+    }
+
+    // Verification needs the digits as they are written: streamed into the file
+    // comparison, and kept whole for the BBP check and the second engine.
+    std::unique_ptr<DigitFileVerifier> file_verifier;
+    bool keep_digits = !options.verify_against.empty();
+    std::string digits_written;
+    auto emit = [&](const char* digits, size_t count) {
+        output->write(digits, count);
+        if (file_verifier) {
+            file_verifier->feed(digits, count);
+        }
+        if (keep_digits) {
+            digits_written.append(digits, count);
+        }
+    };
+
+    engine_options.spigot = options.spigot;
+    std::unique_ptr<DigitEngine> engine = (options.hex_offset >= 0 || options.binary_offset >= 0)
+        ? makeBbpEngine(engine_options)
+        : makeDigitEngine(options.engine, engine_options);
+    // The second engine gets the kernel options, but not the instrumentation or the
+    // checkpoint file of the main run.
+    EngineOptions second_options = engine_options;
+    second_options.spigot.profile = nullptr;
+    second_options.spigot.progress = nullptr;
+    second_options.spigot.checkpoint_path.clear();
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // The second engine runs on its own thread alongside the main computation.
+    std::string second_digits;
+    std::exception_ptr second_failure;
+    std::thread second_engine;
+    if (options.verify_engine_given) {
+        second_engine = std::thread([&]() {
+            try {
+                second_digits = makeDigitEngine(options.verify_engine, second_options)
+                                    ->digits(DigitRequest::decimals(options.digits));
+            }
+            catch (...) {
+                second_failure = std::current_exception();
+            }
+        });
+    }
+
+    try {
+        if (!options.verify_path.empty()) {
+            file_verifier.reset(new DigitFileVerifier(options.verify_path));
+        }
+        if (options.hex_offset >= 0) {
+            engine->stream(DigitRequest(DigitRadix::Hexadecimal, options.hex_offset, options.digits), emit);
+        }
+        else if (options.binary_offset >= 0) {
+            engine->stream(DigitRequest(DigitRadix::Binary, options.binary_offset, options.digits), emit);
+        }
+        else if (!options.cache_path.empty()) {
+            PiDigitCache cache(options.cache_path);
+            PiDigitsView view = options.series_path.empty()
+                ? cachedPiDigits(cache, options.digits, [&engine](long long digits) {
+                      return engine->digits(DigitRequest::decimals(digits));
+                  })
+                : cachedPiDigits(cache, options.digits, [&options](long long digits) {
+                      return calculatePiDigitsChudnovsky(digits, options.series_path);
+                  });
+            emit(view.data, view.size);
+        }
+        else if (!options.series_path.empty()) {
+            std::string digits = calculatePiDigitsChudnovsky(options.digits, options.series_path);
+            emit(digits.data(), digits.size());
+        }
+        else {
+            engine->stream(DigitRequest::decimals(options.digits), emit);
+        }
+    }
+    catch (const std::exception& failure) {
+        if (second_engine.joinable()) {
+            second_engine.join();
+        }
+        std::cerr << "PiTime: " << failure.what() << std::endl;
+        return 1;
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    if (reporter) {
+        reporter->stop();
+    }
+
+    try {
+        output->finish();
+    }
+    catch (const std::exception& failure) {
+        std::cerr << "PiTime: " << failure.what() << std::endl;
+        return 1;
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+
+    std::cout << "Calculation took " << duration.count() << " milliseconds." << std::endl;
+    if (options.profile) {
+        writeSpigotProfile(std::cerr, profile);
+    }
+
+    bool verified = true;
+    try {
+        if (file_verifier) {
+            writeVerificationReport(std::cerr, "'" + options.verify_path + "'", file_verifier->result());
+            verified = verified && file_verifier->result().ok();
+        }
+        if (second_engine.joinable()) {
+            second_engine.join();
+            if (second_failure) {
+                std::rethrow_exception(second_failure);
+            }
+            DigitComparator comparator;
+            size_t common = std::min(digits_written.size(), second_digits.size());
+            comparator.compare(digits_written.data(), second_digits.data(), common);
+            comparator.referenceEnded(digits_written.data() + common, digits_written.size() - common);
+            writeVerificationReport(std::cerr, piEngineName(options.verify_engine), comparator);
+            verified = verified && comparator.ok();
+        }
+        if (options.verify_against == "bbp") {
+            BbpVerification check = verifyPiDigitsBbp(digits_written, options.spigot.threads);
+            writeBbpVerificationReport(std::cerr, check);
+            verified = verified && check.ok;
+        }
+    }
+    catch (const std::exception& failure) {
+        std::cerr << "PiTime: verification failed: " << failure.what() << std::endl;
+        return 2;
+    }
+
+    return verified ? 0 : 2;
+}
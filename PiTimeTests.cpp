@@ -0,0 +1,230 @@
+/*
+* =======================================================================================
+* PiTime Library Tests
+* =======================================================================================
+*
+* Round trips through the parts of the `pitime` library that the command line cannot
+* drive on its own: the built-in digit table, damaged digit cache files, the digit server
+* and the distributed split workers, each against the digits of a local engine. The engine cross-checks run as command line tests(see
+* CMakeLists.txt). Prints every failed check and exits with 1 if there was one.
+*/
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "PiTime.h"
+
+using namespace pitime;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::string computedDigits(PiEngine engine, unsigned long long n) {
+    EngineOptions options;
+    options.use_table = false;
+    return makeDigitEngine(engine, options)->digits(DigitRequest::decimals(n));
+}
+
+// The table against the engines it stands in for, and every prefix it serves.
+void testDigitTable() {
+    EngineOptions options;
+    std::unique_ptr<DigitEngine> table = makeDigitEngine(PiEngine::Chudnovsky, options);
+    std::string digits = table->digits(DigitRequest::decimals(PI_TABLE_DIGITS));
+    check(digits.size() == PI_TABLE_DIGITS + 2, "table: length");
+    const PiEngine engines[] = {PiEngine::Chudnovsky, PiEngine::Spigot, PiEngine::SpigotLimb9, PiEngine::Machin};
+    for (PiEngine engine : engines) {
+        check(digits == computedDigits(engine, PI_TABLE_DIGITS),
+              "table: equals the " + std::string(piEngineName(engine)) + " engine");
+    }
+    for (unsigned long long n = 0; n <= PI_TABLE_DIGITS; ++n) {
+        if (table->digits(DigitRequest::decimals(n)) != digits.substr(0, static_cast<size_t>(n) + 2)) {
+            check(false, "table: prefix of " + std::to_string(n) + " decimals");
+            break;
+        }
+    }
+}
+
+void writeFile(const std::string& path, const std::string& contents) {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// A cache file that is empty or cut short reads as an empty cache and is rebuilt.
+void testDigitCache() {
+    const std::string path = "pitime-test-cache.bin";
+    const std::string expected = computedDigits(PiEngine::Chudnovsky, 500);
+    auto compute = [](long long n) { return computedDigits(PiEngine::Chudnovsky, static_cast<unsigned long long>(n)); };
+    std::remove(path.c_str());
+    {
+        PiDigitCache cache(path);
+        cachedPiDigits(cache, 500, compute);
+    }
+    const std::string valid = readFile(path);
+    const std::string damaged[][2] = {
+        { "empty", "" },
+        { "truncated header", valid.substr(0, 20) },
+        { "truncated digits", valid.substr(0, valid.size() - 10) },
+    };
+    for (const auto& file : damaged) {
+        writeFile(path, file[1]);
+        PiDigitCache cache(path);
+        check(cache.digitCount() == -1, "cache: " + file[0] + " file reads as empty");
+        PiDigitsView view = cachedPiDigits(cache, 500, compute);
+        check(std::string(view.data, view.size) == expected, "cache: " + file[0] + " file recomputed");
+        check(PiDigitCache(path).digitCount() == 500, "cache: " + file[0] + " file rebuilt");
+    }
+    std::remove(path.c_str());
+}
+
+#ifndef _WIN32
+std::string socketPath(const std::string& role) {
+    return "/tmp/pitime-test-" + std::to_string(::getpid()) + "-" + role + ".sock";
+}
+
+// A client of the digit server's line protocol.
+class LineClient {
+public:
+    explicit LineClient(const std::string& path) : fd(::socket(AF_UNIX, SOCK_STREAM, 0)) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        connected = fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+
+    ~LineClient() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool connected;
+
+    // Sends `line` and returns the answer without its newline; empty on a lost connection.
+    std::string ask(const std::string& line) {
+        std::string request = line + "\n";
+        if (::send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size())) {
+            return std::string();
+        }
+        std::string answer;
+        char chunk[4096];
+        while (answer.empty() || answer.back() != '\n') {
+            ssize_t got = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (got <= 0) {
+                return std::string();
+            }
+            answer.append(chunk, static_cast<size_t>(got));
+        }
+        answer.pop_back();
+        return answer;
+    }
+
+private:
+    int fd;
+};
+
+void testDigitServer() {
+    std::string path = socketPath("server");
+    EngineOptions options;
+    SharedPiDigits digits(PiEngine::Chudnovsky, options, 50000);
+    DigitServer server(path, digits);
+    std::thread runner([&server]() { server.run(); });
+    {
+        std::string expected = computedDigits(PiEngine::Chudnovsky, 30000);
+        LineClient client(path);
+        LineClient other(path);
+        check(client.connected && other.connected, "server: connect");
+        check(client.ask("10") == expected.substr(0, 12), "server: 10 digits from the table");
+        check(client.ask(std::to_string(PI_TABLE_DIGITS)) == expected.substr(0, PI_TABLE_DIGITS + 2),
+              "server: the whole table");
+        check(client.ask("30000") == expected, "server: 30000 digits computed");
+        check(other.ask("20000") == expected.substr(0, 20002), "server: a prefix of the shared expansion");
+        check(client.ask("abc").compare(0, 7, "error: ") == 0, "server: invalid count refused");
+        check(client.ask("50001").compare(0, 7, "error: ") == 0, "server: count over the maximum refused");
+        check(client.ask("9000000000000000000").compare(0, 7, "error: ") == 0, "server: count out of range refused");
+        check(client.ask("5") == expected.substr(0, 7), "server: connection stays open after errors");
+    }
+    server.stop();
+    runner.join();
+}
+
+void testSplitWorkers() {
+    std::string first = socketPath("worker1");
+    std::string second = socketPath("worker2");
+    SplitWorker worker(first, 2);
+    SplitWorker other(second, 1);
+    std::thread runner([&worker]() { worker.run(); });
+    std::thread other_runner([&other]() { other.run(); });
+    {
+        EngineOptions options;
+        options.use_table = false;
+        options.nodes.push_back(first);
+        options.nodes.push_back(second);
+        options.nodes.push_back(first);
+        std::unique_ptr<DigitEngine> engine = makeDigitEngine(PiEngine::Chudnovsky, options);
+        // The second request extends the series of the first.
+        check(engine->digits(DigitRequest::decimals(20000)) == computedDigits(PiEngine::Chudnovsky, 20000),
+              "workers: 20000 digits");
+        check(engine->digits(DigitRequest::decimals(60000)) == computedDigits(PiEngine::Chudnovsky, 60000),
+              "workers: extended to 60000 digits");
+
+        EngineOptions unreachable = options;
+        unreachable.nodes.assign(1, socketPath("missing"));
+        bool refused = false;
+        try {
+            makeDigitEngine(PiEngine::Chudnovsky, unreachable)->digits(DigitRequest::decimals(5000));
+        }
+        catch (const std::runtime_error&) {
+            refused = true;
+        }
+        check(refused, "workers: a split without a reachable worker fails");
+    }
+    worker.stop();
+    other.stop();
+    runner.join();
+    other_runner.join();
+}
+#endif
+
+}  // namespace
+
+int main() {
+    testDigitTable();
+    testDigitCache();
+#ifndef _WIN32
+    testDigitServer();
+    testSplitWorkers();
+#endif
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}